@@ -0,0 +1,100 @@
+#ifndef DISTPIPELINEFWK_BALANCING_SPLITTER_HPP
+#define DISTPIPELINEFWK_BALANCING_SPLITTER_HPP
+
+#include <functional>
+#include <limits>
+
+#include "base_splitter.hpp"
+
+/*
+ * BaseSplitter broadcasts each message to all of it's targets. BalancingSplitter
+ * sends each data message to exactly one target, so the independent channels
+ * or frames can be distributed over several identical worker chains without
+ * duplicating the work. The target is selected by the strategy:
+ *
+ * ROUND_ROBIN - targets are used in turn;
+ *
+ * LEAST_LOADED - the target with the shortest input queue (BaseNode::queue_size),
+ * the ties are resolved in the round robin order;
+ *
+ * HASH_BY_KEY - the target is key(msg) % (number of targets), so all messages
+ * with the same key go to the same chain. By default the key is the message
+ * UID, set a key function to shard by channel etc.
+ *
+ * The order of messages is preserved only within one target. Command messages
+ * (USER) are still broadcast to all targets, so each chain can be reconfigured.
+ */
+template<typename tIn>
+class BalancingSplitter : public BaseSplitter<tIn>{
+public:
+    using tBase = BaseSplitter<tIn>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrNext = typename tBase::tPtrNext;
+    using tKeyFunc = std::function<size_t(tIn&)>;
+
+    enum STRATEGY {ROUND_ROBIN, LEAST_LOADED, HASH_BY_KEY};
+
+protected:
+    friend class NodeFactory;
+    BalancingSplitter(STRATEGY strategy = STRATEGY::ROUND_ROBIN, QUEUE_POLICY pol = QUEUE_POLICY::DROP,
+                      std::string name = "BalancingSplitter", tKeyFunc key = nullptr):
+            tBase(pol, name),
+            strategy{strategy},
+            key{key} {}
+
+    virtual bool process_usr_msg(tPtrIn&& msg){
+        if(this->targets.empty()){
+            std::cerr << tBase::name << " broken pipe" << std::endl;
+            return false;
+        }
+
+        if(msg->cmd != MSG_CMD::NONE)
+            return tBase::process_usr_msg(std::move(msg));
+
+        auto target = select(*msg);
+        make_writable(msg);
+        if(!target->put(std::move(msg), this->uid, this->pol))
+            std::cerr << tBase::name << " warning: target \"" << target->get_name()
+                      << "\" failed to receive a message" << std::endl;
+        return true;
+    }
+
+private:
+    tPtrNext& select(tIn& msg){
+        auto& targets = this->targets;
+        size_t n = targets.size();
+
+        size_t idx = 0;
+        if(strategy == STRATEGY::HASH_BY_KEY){
+            idx = (key ? key(msg) : msg.get_uid()) % n;
+        }else if(strategy == STRATEGY::LEAST_LOADED){
+            // scan starting from the round robin position, so the equally
+            // loaded targets are used in turn
+            size_t best = std::numeric_limits<size_t>::max();
+            auto it = targets.begin();
+            std::advance(it, next % n);
+            for(size_t i = 0; i < n; i++, it++){
+                if(it == targets.end()) it = targets.begin();
+                auto sz = (*it)->queue_size();
+                if(sz < best){
+                    best = sz;
+                    idx = (next + i) % n;
+                }
+            }
+            next = idx + 1;
+        }else{
+            idx = next++ % n;
+        }
+
+        auto it = targets.begin();
+        std::advance(it, idx);
+        return *it;
+    }
+
+private:
+    STRATEGY strategy;
+    tKeyFunc key;
+    size_t next = 0;
+};
+
+#endif //DISTPIPELINEFWK_BALANCING_SPLITTER_HPP
@@ -30,23 +30,9 @@ protected:
 protected:
     virtual bool process_usr_msg(tPtrIn&& msg){
         if(next){
-            BaseMessage tmp((BaseMessage&)*msg);
-            tPtrOut out_msg;
-
-            if(external_filter) {
-                out_msg = external_filter(move(msg));
-            }else {
-                out_msg = internal_filter(move(msg));
-            }
-
+            tPtrOut out_msg = apply_filter(move(msg));
             if(!out_msg) return true;
 
-            if(out_msg->keep_prev_attached_data) {
-                out_msg->init_attached_data(tmp);
-            }else{
-                out_msg->keep_prev_attached_data = true;
-            }
-
             return next->put(move(out_msg), this->uid, pol);
         }else{
             std::cerr << tBase::name << " warning: broken pipe detected" << std::endl;
@@ -54,10 +40,47 @@ protected:
         }
     };
 
+    /*
+     * Call the filter function and move the data attached to the input
+     * message into the output one (unless the filter has asked to flush it).
+     * It is separated from process_usr_msg to be reused when the filter
+     * is called directly, without a node queue (see FilterStage).
+     */
+    tPtrOut apply_filter(tPtrIn&& msg){
+        BaseMessage tmp((BaseMessage&)*msg);
+        tPtrOut out_msg;
+
+        if(external_filter) {
+            out_msg = external_filter(move(msg));
+        }else {
+            out_msg = internal_filter(move(msg));
+        }
+
+        if(!out_msg) return nullptr;
+
+        // the filter may return it's input message, that can be shared
+        make_writable(out_msg);
+
+        if(out_msg->keep_prev_attached_data) {
+            out_msg->inherit_attached_data(tmp);
+        }else{
+            out_msg->keep_prev_attached_data = true;
+        }
+
+        return out_msg;
+    }
+
 public:
-    void set_target(tPtrNext target){next = target;}
+    void set_target(tPtrNext target){
+        next = target;
+        if(next) next->reg_upstream(this, pol);
+    }
 
 protected:
+    /*
+     * The input message can be shared with the other branches of a splitter,
+     * a filter function that modifies it in place shell call make_writable(msg).
+     */
     std::function<tPtrOut(tPtrIn&&)> external_filter;
     virtual tPtrOut internal_filter(tPtrIn&&){return nullptr;}
 
@@ -8,15 +8,22 @@
 #include <memory>
 #include <iostream>
 #include <thread>
+#include <future>
 #include <mutex>
 #include <condition_variable>
 #include <list>
+#include <vector>
 #include <chrono>
 #include <string>
 #include <functional>
+#include <atomic>
+#include <algorithm>
 
 #include "data_packet_types.h"
 #include "node_factory.hpp"
+#include "ring_queue.hpp"
+#include "executor.hpp"
+#include "span_trace.h"
 
 //***************BASE THREAD WITH INPUT MESSAGE QUEUE***********************
 /*
@@ -35,13 +42,20 @@
  */
 
 template<typename tIn>
-class BaseNode : public CommandNode{
+class BaseNode : public CommandNode, private IPoolTask{
     static_assert(std::is_base_of<BaseMessage,tIn>(),
                   "The tIn shell be derived from BaseMessage class");
 
 public:
     using tPtrIn = std::shared_ptr<tIn>;
 
+private:
+    // an input queue element, 'stale_ns' is the DROP_STALE deadline (zero - none)
+    struct QEntry{
+        tPtrIn msg;
+        uint64_t stale_ns;
+    };
+
 protected:
     friend class NodeFactory;
     BaseNode(std::string name = "BaseNode"): CommandNode(name) {}
@@ -65,77 +79,214 @@ public:
 
     std::string get_name(){return name;}
 
+    /*
+     * The number of messages waiting in the input queue. It is approximate,
+     * the queue is changing concurrently, but it is good enough to balance the
+     * load between the nodes (see BalancingSplitter).
+     */
+    virtual size_t queue_size(){
+        if(q_type == QUEUE_TYPE::LIST){
+            std::unique_lock<std::mutex> lck(local_state_mtx);
+            return in.size() + ctl.size() + (mailbox ? 1 : 0);
+        }
+        return ring_size() + ctl_size + (has_mail ? 1 : 0);
+    }
+
+    /*
+     * A pool worker that waits for this node to consume it's input runs the
+     * node task itself, see WorkStealingPool::help. False if the node is not
+     * pooled or it's task is not pending.
+     */
+    bool help_drain(){
+        return pooled && WorkStealingPool::instance().help(this);
+    }
+
     void start(){
+        start_async();
+        wait_started();
+    }
+
+    void stop(){
+        stop_async();
+        wait_stopped();
+    }
+
+    void start_async(){
+        if(v_running) return;
+
+        // the thread has finished by itself, e.g. a source failed to open a port
+        if(own_thread.joinable()) own_thread.join();
+
+        init_queue();
+        pooled = false;
+        scheduled = false;
+        started = std::promise<void>();
+        started_f = started.get_future();
         own_thread = std::thread(run,this);
-        // wait until the process starts
-        while(!v_running)
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // the node thread confirms the start in 'run', no polling
+    void wait_started(){
+        if(!started_f.valid()) return;
+        started_f.wait();
+        started_f = std::future<void>();
 
         std::cout << name << " started" << std::endl;
     }
 
-    void stop(){
+    void stop_async(){
         if(!v_running) return;
-
         put(MSG_CMD::STOP, uid, QUEUE_POLICY::WAIT);
+    }
+
+    void wait_stopped(){
+        if(!own_thread.joinable()) return;
         own_thread.join();
 
+        // the pool task processes the STOP asynchronously
+        if(pooled){
+            std::unique_lock<std::mutex> lck(ring_mtx);
+            ring_cv.wait(lck, [this]{return !v_running;});
+        }
+
         std::cout << name << " stopped" << std::endl;
     }
 
-    bool put(tPtrIn&& val, unsigned int sent_from, QUEUE_POLICY pol = QUEUE_POLICY::DROP){
+    bool is_running(){return v_running;}
 
-        // no messages can be accepted until the node thread was started
-        // when nodes are closing their threads this is a normal situation, so return true
-        if(!v_running) return true;
+    /*
+     * Wait until the input queue is empty or the node is stopped. The consumer
+     * notifies only when somebody waits, so it costs nothing otherwise.
+     */
+    void wait_drained(){
+        std::unique_lock<std::mutex> lck(drain_mtx);
+        drain_waiters++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        drain_cv.wait(lck, [this]{return !v_running || queue_size() == 0;});
+        drain_waiters--;
+    }
+
+    bool put(tPtrIn&& val, unsigned int sent_from, QUEUE_POLICY pol = QUEUE_POLICY::DROP){
 
         // a null pointers are used when a node that has an output does not want to send
         // anything, for example it has received and processed any command message
         if(!val) return true;
 
-        // store the msg source inside the message
-        val->sent_from = sent_from;
+        // no messages can be accepted until the node thread was started
+        // when nodes are closing their threads this is a normal situation, so return true
+        if(!v_running){
+            stats.drop(DROP_REASON::NOT_RUNNING);
+            return true;
+        }
+
+        // store the msg source inside the message, a shared message (see make_writable)
+        // is sent to all targets from the same node, so it is written only once
+        if(val->sent_from != sent_from) val->sent_from = sent_from;
+
+        // the payload size is used to limit the queue memory (see NodeAttr)
+        size_t sz = val->payload_size();
+        auto& edge = stats.edges.slot(sent_from);
+
+        // the next hop of a traced message
+        if(attr.trace_start || val->trace)
+            trace_enqueue(val);
+
+        // the flow arrow starts in the span of the sender, it is recorded
+        // only if the message is accepted
+        FlowOut flow;
+        if(SpanTracer::enabled() && val->cmd == MSG_CMD::NONE){
+            flow.id = SpanTracer::flow_id(val->get_uid(), uid);
+            flow.ts = stats_now_ns();
+        }
+
+        // the commands bypass the data queue, they are always accepted
+        if(is_control(val)) return put_ctl(val, edge);
+
+        // the single-slot mailbox
+        if(pol == QUEUE_POLICY::COALESCE_LATEST) return put_mailbox(val, edge, flow);
+
+        // the dequeue deadline of the DROP_STALE message
+        uint64_t stale_ns = 0;
+        if(pol == QUEUE_POLICY::DROP_STALE && attr.max_age.count() > 0)
+            stale_ns = stats_now_ns() + std::chrono::duration_cast<std::chrono::nanoseconds>(attr.max_age).count();
+
+        // lock-free input queue
+        if(q_type != QUEUE_TYPE::LIST) return put_ring(val, sz, pol, edge, stale_ns, flow);
 
         // lock a local state for inter-thread communication
         std::unique_lock<std::mutex> lck(local_state_mtx);
 
+        // DROP_OLDEST makes room by discarding the oldest data messages
+        if(pol == QUEUE_POLICY::DROP_OLDEST)
+            while(is_full(in.size(), in_bytes, sz) && evict_oldest_locked());
+
         // input queue is full
-        if(in.size() > 10){
+        if(is_full(in.size(), in_bytes, sz)){
             if(pol == QUEUE_POLICY::WAIT){
-                // std::cout << "BaseNode.put(): in.size() > 10" << std::endl;
-                // unlock local state and wait until the queue shortens
-                // when the event arrive local state will be relocked
-                event.wait(lck,[this]{return in.size() <= 10;});
-            }else if(pol == QUEUE_POLICY::DROP){
+                // unlock local state and wait until the queue drains down to the
+                // low watermark, when the event arrive local state will be relocked;
+                // the loop is needed because the other producer can fill the queue first
+                auto t0 = stats_now_ns();
+                bool worker = WorkStealingPool::in_worker();
+                unsigned rounds = 0;
+                while(is_full(in.size(), in_bytes, sz)){
+                    // the pool worker shell not block, see WorkStealingPool::help
+                    bool helped = false;
+                    if(worker){
+                        lck.unlock();
+                        helped = help_pool(rounds);
+                        lck.lock();
+                    }
+                    if(!helped){
+                        auto pred = [&]{return is_low(in.size(), in_bytes) || !v_running;};
+                        in_waiters++;
+                        if(worker) event.wait_for(lck, std::chrono::milliseconds(1), pred);
+                        else event.wait(lck, pred);
+                        in_waiters--;
+                    }
+                    if(!v_running){
+                        stats.drop(DROP_REASON::NOT_RUNNING);
+                        return true;
+                    }
+                }
+                block_done(t0);
+            }else{
+                // DROP, DROP_STALE or DROP_OLDEST with nothing to evict:
                 // the message was sent via rvalue, so it is dropped if not stored
                 // in this case the message shared_ptr<> destructor is called
                 // it is a normal behaviour for slow nodes, so we return true
+                stats.drop(DROP_REASON::QUEUE_FULL);
+                edge.drops.fetch_add(1, std::memory_order_relaxed);
                 return true;
             }
         }
 
         // push the message, notify local thread if it was blocked and
         // confirm received by returning true
-        in.push_back(move(val));
+        in.push_back(QEntry{move(val), stale_ns});
+        in_bytes += sz;
+        stats.depth(in.size());
         event.notify_one();
+        lck.unlock();
 
-        // 'lck' destructor unlocks 'local_state_mtx' automatically
+        accepted(edge, flow);
+        schedule();
         return true;
     }
 
     /*
      * It is used to send a command to this particular node.
      * This function simplifies the usage of a generic "put" routine defined
-     * above.
+     * above. The command goes to the priority lane of the node, so it never
+     * waits for a room in the data queue and the policy is not used.
      */
     bool put(MSG_CMD cmd, unsigned int sent_from,
              QUEUE_POLICY pol = QUEUE_POLICY::WAIT,
-             std::shared_ptr<ICloneable>&& user_data = nullptr){
+             std::shared_ptr<const ICloneable>&& user_data = nullptr){
 
         auto msg = tPtrIn(new typename tPtrIn::element_type);
         msg->cmd = cmd;
         msg->user_data = user_data;
-
         return put(move(msg), sent_from, pol);
     }
 
@@ -150,9 +301,35 @@ protected:
      * the warning will indicate on that.
      */
     virtual void main_loop(){
+        if(attr.exec_mode == EXEC_MODE::POOL){
+            // the node becomes a task of the shared pool (see executor.hpp),
+            // the own thread is not needed anymore and will exit
+            pooled = true;
+            schedule();
+            return;
+        }
+
+        if(attr.batch_size > 1){
+            // batch mode, see NodeAttr::batch_size
+            std::vector<tPtrIn> batch;
+            batch.reserve(attr.batch_size);
+            do{
+                if(!pull_msg_batch(batch, attr.batch_size)) fire_deadline();
+            }while(dispatch_batch(batch));
+
+            clear_queue();
+            return;
+        }
+
         tPtrIn curr_in;
         while(1){
             curr_in = pull_msg();
+            if(!curr_in){
+                fire_deadline();
+                continue;
+            }
+            if(curr_in->trace) trace_dequeue(curr_in);
+
             if(curr_in->cmd == MSG_CMD::STOP){
                 break;
             }else if(curr_in->cmd == MSG_CMD::USER && curr_in->user_data){
@@ -160,13 +337,35 @@ protected:
                 curr_in->user_data->apply(this);
             }
 
-            if(!process_usr_msg(move(curr_in))){
+            auto t0 = stats_now_ns();
+            if(SpanTracer::enabled()) span_flow_in(curr_in, t0);
+            bool ret_val = process_usr_msg(move(curr_in));
+            auto t1 = stats_now_ns();
+            stats.proc_time.record(t1 - t0);
+            if(SpanTracer::enabled()) SpanTracer::span(SpanTracer::KIND::PROCESS, uid, t0, t1);
+            stats.processed.fetch_add(1, std::memory_order_relaxed);
+
+            if(!ret_val){
                 std::cerr << name << " warning: process_usr_msg failed" << std::endl;
             }
         }
 
         // discard all messages received after the "STOP" command
-        in.clear();
+        clear_queue();
+    }
+
+    /*
+     * Batch counterpart of process_usr_msg, it is called by the main_loop when
+     * NodeAttr::batch_size > 1. A node can override it to amortize a per-message
+     * setup over a burst of messages. The batch is never empty and it's order
+     * is the arrival order. The default implementation just calls process_usr_msg
+     * for each message, so the nodes that do not care about batches work as usual.
+     */
+    virtual bool process_usr_batch(std::vector<tPtrIn>& batch){
+        bool ret_val = true;
+        for(auto& msg : batch)
+            ret_val = process_usr_msg(move(msg)) && ret_val;
+        return ret_val;
     }
 
     virtual bool process_usr_msg(tPtrIn&& msg){
@@ -179,29 +378,704 @@ protected:
     };
 
     tPtrIn pull_msg(bool wait = true){
+        if(q_type != QUEUE_TYPE::LIST){
+            auto val = pull_ring(wait);
+            if(ring_size() == 0) drained();
+            return val;
+        }
+
         std::unique_lock<std::mutex> lck(local_state_mtx);
-        if(wait){
-            event.wait(lck,[=]{return !in.empty();});
-        }else if(in.empty()){
-            return nullptr;
+        tPtrIn curr_in;
+        while(!curr_in){
+            if(wait){
+                uint64_t t0 = list_empty_locked() && SpanTracer::enabled() ? stats_now_ns() : 0;
+                bool ready = wait_input(event, lck, [=]{return !list_empty_locked();});
+                wait_done(t0);
+                if(!ready) break;
+            }else if(list_empty_locked()){
+                break;
+            }
+            curr_in = pop_list_locked();
         }
-        tPtrIn curr_in = in.front();
-        in.pop_front();
-        event.notify_one();
+
+        // wake blocked producers only when the low watermark is reached
+        if(in_waiters > 0 && is_low(in.size(), in_bytes))
+            event.notify_all();
+        bool empty = in.empty();
+        lck.unlock();
+
+        if(empty) drained();
         return curr_in;
     }
 
+    /*
+     * Move up to 'max' messages from the input queue into 'batch' with a single
+     * lock acquisition (or a sequence of lock-free pops in the case of the ring).
+     * Command messages (STOP, USER) are never batched together with the data:
+     * a command is always returned alone and before the data, so the main loop
+     * handles it at once. Returns the number of messages appended.
+     */
+    size_t pull_msg_batch(std::vector<tPtrIn>& batch, size_t max, bool wait = true){
+        if(q_type != QUEUE_TYPE::LIST){
+            size_t n = pull_ring_batch(batch, max, wait);
+            if(ring_size() == 0) drained();
+            return n;
+        }
+
+        std::unique_lock<std::mutex> lck(local_state_mtx);
+        size_t n = 0;
+        while(n == 0){
+            if(wait){
+                uint64_t t0 = list_empty_locked() && SpanTracer::enabled() ? stats_now_ns() : 0;
+                bool ready = wait_input(event, lck, [=]{return !list_empty_locked();});
+                wait_done(t0);
+                if(!ready) break;
+            }else if(list_empty_locked()){
+                break;
+            }
+
+            tPtrIn cmd;
+            if(pop_ctl_locked(cmd)){
+                batch.push_back(move(cmd));
+                n++;
+                break;
+            }
+
+            while(n < max){
+                // the mailbox is served after the queue
+                if(in.empty()){
+                    if(mailbox){
+                        batch.push_back(take_mailbox_locked());
+                        n++;
+                    }
+                    break;
+                }
+
+                auto msg = pop_list_locked();
+                if(!msg) continue;
+                batch.push_back(move(msg));
+                n++;
+            }
+        }
+
+        if(in_waiters > 0 && is_low(in.size(), in_bytes))
+            event.notify_all();
+        bool empty = in.empty();
+        lck.unlock();
+
+        if(empty) drained();
+        return n;
+    }
+
+    /*
+     * A node that has to act at a given time even if no message arrives (see
+     * BaseSyncJoin::JoinPolicy::max_age) sets the deadline in stats_now_ns units,
+     * zero - no deadline. The waiting main loop calls on_deadline when it is
+     * reached, the deadline is cleared before the call. It shell be called from
+     * the node thread. In the pool mode nothing waits, the deadline is checked
+     * at the end of each slice only.
+     */
+    void set_deadline(uint64_t ns){
+        deadline_ns = ns;
+    }
+
+    virtual void on_deadline(){}
+
 private:
+    static bool is_control(const tPtrIn& msg){
+        return msg->cmd == MSG_CMD::STOP || msg->cmd == MSG_CMD::USER;
+    }
+
+    //*************** FRESH DATA POLICIES (see QUEUE_POLICY) ***************
+
+    // the flow arrow of a data message (see span_trace.h), ts = 0 - not traced
+    struct FlowOut{
+        uint64_t id = 0;
+        uint64_t ts = 0;
+    };
+
+    // a data message is in the queue, the flow arrow starts at the put time
+    void accepted(EdgeStats::Slot& edge, const FlowOut& flow){
+        stats.msgs_in.fetch_add(1, std::memory_order_relaxed);
+        edge.msgs.fetch_add(1, std::memory_order_relaxed);
+        if(flow.ts) SpanTracer::flow(SpanTracer::KIND::FLOW_OUT, flow.id, flow.ts);
+    }
+
+    // a queued message is lost, it is accounted to it's sender
+    void drop_queued(const tPtrIn& msg, DROP_REASON r){
+        stats.drop(r);
+        stats.edges.slot(msg->sent_from).drops.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the message of the entry, or null if it has waited too long (DROP_STALE)
+    tPtrIn fresh(QEntry& e){
+        if(e.stale_ns && stats_now_ns() > e.stale_ns){
+            drop_queued(e.msg, DROP_REASON::STALE);
+            return nullptr;
+        }
+        return move(e.msg);
+    }
+
+    // local_state_mtx shell be locked
+    bool list_empty_locked() const {
+        return in.empty() && ctl.empty() && !mailbox;
+    }
+
+    // local_state_mtx shell be locked, the commands are served first and the mailbox last
+    tPtrIn pop_list_locked(){
+        tPtrIn cmd;
+        if(pop_ctl_locked(cmd)) return cmd;
+        if(in.empty()) return take_mailbox_locked();
+        QEntry e = std::move(in.front());
+        in.pop_front();
+        in_bytes -= e.msg->payload_size();
+        return fresh(e);
+    }
+
+    // local_state_mtx shell be locked, false if the queue is empty
+    bool evict_oldest_locked(){
+        if(in.empty()) return false;
+        in_bytes -= in.front().msg->payload_size();
+        drop_queued(in.front().msg, DROP_REASON::EVICTED_OLDEST);
+        in.pop_front();
+        return true;
+    }
+
+    // RING_MPSC only: the ring is safe for many consumers, so the producer can take the head
+    bool evict_oldest_ring(){
+        QEntry e;
+        if(!mpsc->try_pop(e)) return false;
+        q_bytes -= e.msg->payload_size();
+        drop_queued(e.msg, DROP_REASON::EVICTED_OLDEST);
+        return true;
+    }
+
+    // the mutex of the command lane and the mailbox, it is the one the consumer waits with
+    std::mutex& lane_mtx(){
+        return q_type == QUEUE_TYPE::LIST ? local_state_mtx : ring_mtx;
+    }
+
+    // lane_mtx() shell be locked
+    void notify_consumer_locked(){
+        if(q_type == QUEUE_TYPE::LIST) event.notify_all();
+        else ring_cv.notify_all();
+    }
+
+    bool put_mailbox(tPtrIn& val, EdgeStats::Slot& edge, const FlowOut& flow){
+        {
+            std::unique_lock<std::mutex> lck(lane_mtx());
+            if(mailbox) drop_queued(mailbox, DROP_REASON::COALESCED);
+            mailbox = move(val);
+            has_mail = true;
+            notify_consumer_locked();
+        }
+
+        accepted(edge, flow);
+        schedule();
+        return true;
+    }
+
+    // lane_mtx() shell be locked
+    tPtrIn take_mailbox_locked(){
+        has_mail = false;
+        return move(mailbox);
+    }
+
+    // handle one batch received in the main loop, returns false on STOP
+    bool dispatch_batch(std::vector<tPtrIn>& batch){
+        if(batch.empty()) return true;
+
+        for(auto& msg : batch)
+            if(msg->trace) trace_dequeue(msg);
+
+        if(batch.size() == 1){
+            auto& msg = batch.front();
+            if(msg->cmd == MSG_CMD::STOP){
+                batch.clear();
+                return false;
+            }else if(msg->cmd == MSG_CMD::USER && msg->user_data){
+                msg->user_data->apply(this);
+            }
+        }
+
+        // the batch time is accounted as the same time of each message
+        size_t n = batch.size();
+        auto t0 = stats_now_ns();
+        bool tracing = SpanTracer::enabled();
+        if(tracing)
+            for(auto& msg : batch) span_flow_in(msg, t0);
+        bool ret_val = process_usr_batch(batch);
+        auto t1 = stats_now_ns();
+        if(tracing) SpanTracer::span(SpanTracer::KIND::PROCESS, uid, t0, t1);
+        auto dt = (t1 - t0)/n;
+        for(size_t i = 0; i < n; i++) stats.proc_time.record(dt);
+        stats.processed.fetch_add(n, std::memory_order_relaxed);
+
+        if(!ret_val)
+            std::cerr << name << " warning: process_usr_batch failed" << std::endl;
+
+        batch.clear();
+        return true;
+    }
+
+    //*************** MESSAGE TRACING ***************
+
+    void trace_enqueue(tPtrIn& val){
+        // the hop is written into the message, a shared one (see BaseSplitter with
+        // share_payload) is copied first, so the other targets don't see it
+        make_writable(val);
+
+        auto now = stats_now_ns();
+        if(attr.trace_start)
+            val->trace = std::make_shared<TraceHop>(nullptr, uid, now);
+        else if(val->trace->depth + 1 < TraceHop::max_hops)
+            val->trace = std::make_shared<TraceHop>(val->trace, uid, now);
+    }
+
+    void trace_dequeue(tPtrIn& msg){
+        // the hop was not added, the trace is too long
+        if(msg->trace->node != uid) return;
+
+        auto now = stats_now_ns();
+        msg->trace->deq_ns = now;
+        if(attr.trace_sink) TraceAggregator::global().add(msg->trace, now);
+    }
+
+    //*************** EXECUTION SPANS (see span_trace.h) ***************
+
+    // the flow arrow of the message ends in the span that starts at 't0'
+    void span_flow_in(tPtrIn& msg, uint64_t t0){
+        if(msg->cmd == MSG_CMD::NONE)
+            SpanTracer::flow(SpanTracer::KIND::FLOW_IN, SpanTracer::flow_id(msg->get_uid(), uid), t0);
+    }
+
+    // a WAIT producer was blocked on this node since 't0'
+    void block_done(uint64_t t0){
+        auto t1 = stats_now_ns();
+        stats.block(t1 - t0);
+        if(SpanTracer::enabled()) SpanTracer::span(SpanTracer::KIND::BLOCKED, uid, t0, t1);
+    }
+
+    // the node thread was waiting for the input since 't0'
+    void wait_done(uint64_t t0){
+        if(t0) SpanTracer::span(SpanTracer::KIND::WAIT_INPUT, uid, t0, stats_now_ns());
+    }
+
+    // wait for the input until the deadline if any, false - it was reached
+    template<typename P>
+    bool wait_input(std::condition_variable& cv, std::unique_lock<std::mutex>& lck, P pred){
+        if(!deadline_ns){
+            cv.wait(lck, pred);
+            return true;
+        }
+        using namespace std::chrono;
+        return cv.wait_until(lck, steady_clock::time_point(duration_cast<steady_clock::duration>(nanoseconds(deadline_ns))), pred);
+    }
+
+    void fire_deadline(){
+        deadline_ns = 0;
+        on_deadline();
+    }
+
     /*
      * This static function is used to start a new thread.
      * It wraps a "main_loop", which can be overwritten.
      */
     static void run(BaseNode* f){
+        // the scheduling attributes belong to this thread, a pooled node leaves
+        // it at once and the pool workers are never affected
+        if(!f->attr.sched.is_default())
+            apply_thread_sched(f->attr.sched, f->name);
+
         f->v_running = true;
+        f->started.set_value();
         f->main_loop();
+
+        // the pooled node is still running as a task
+        if(f->pooled) return;
+
         f->v_running = false;
+        f->wake_all();
     };
 
+    // called by SchedCmd in the main loop, so it is the node thread
+    virtual void set_sched(const SchedAttr& sched){
+        if(pooled){
+            std::cerr << name << " warning: scheduling attributes are ignored in the pool mode" << std::endl;
+            return;
+        }
+        attr.sched = sched;
+        apply_thread_sched(sched, name);
+    }
+
+    //*************** POOL EXECUTION ***************
+
+    // submit the node to the pool unless it is already there
+    void schedule(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(pooled.load(std::memory_order_relaxed) && !scheduled.exchange(true))
+            WorkStealingPool::instance().submit(this);
+    }
+
+    /*
+     * Pool task body: process up to NodeAttr::pool_slice batches, so the other
+     * tasks are not starved, and resubmit itself if there is more work.
+     */
+    virtual void run_slice(){
+        size_t k = attr.batch_size > 1 ? attr.batch_size : 1;
+        size_t slice = attr.pool_slice ? attr.pool_slice : 1;
+        for(size_t i = 0; i < slice; i++){
+            if(!pull_msg_batch(slice_batch, k, false)) break;
+            if(!dispatch_batch(slice_batch)){
+                // STOP received, the 'scheduled' flag stays set until restart
+                clear_queue();
+                v_running = false;
+                wake_all();
+                return;
+            }
+        }
+
+        if(deadline_ns && stats_now_ns() >= deadline_ns) fire_deadline();
+
+        scheduled = false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!queue_empty() && !scheduled.exchange(true))
+            WorkStealingPool::instance().submit(this);
+    }
+
+    /*
+     * A pool worker waits for this node to drain it's queue. It runs the task of
+     * the pooled node itself; if it can't (a THREAD node, or the task is running
+     * on the other worker) it yields for a few rounds. False means the worker
+     * shell park on the queue condition: the wait is timed, so the worker comes
+     * back to help if the node turns out to depend on the pool.
+     */
+    bool help_pool(unsigned& rounds){
+        if(help_drain()){
+            rounds = 0;
+            return true;
+        }
+        if(++rounds > pool_spin_rounds) return false;
+        std::this_thread::yield();
+        return true;
+    }
+
+    static constexpr unsigned pool_spin_rounds = 64;
+
+    bool queue_empty(){
+        if(q_type == QUEUE_TYPE::LIST){
+            std::unique_lock<std::mutex> lck(local_state_mtx);
+            return list_empty_locked();
+        }
+        return ring_size() == 0 && ctl_size == 0 && !has_mail;
+    }
+
+    // select and allocate the input queue, it is called before the node thread starts
+    void init_queue(){
+        q_type = attr.queue_type;
+        if(q_type == QUEUE_TYPE::AUTO)
+            q_type = n_upstream == 1 ? QUEUE_TYPE::RING_SPSC : QUEUE_TYPE::RING_MPSC;
+        if(q_type == QUEUE_TYPE::RING_SPSC && drop_oldest_upstream){
+            // the producer can't evict the head of the SPSC ring, see QUEUE_POLICY::DROP_OLDEST
+            if(attr.queue_type == QUEUE_TYPE::RING_SPSC)
+                std::cerr << name << " warning: an upstream node sends with DROP_OLDEST, RING_MPSC is used" << std::endl;
+            q_type = QUEUE_TYPE::RING_MPSC;
+        }
+        if(q_type == QUEUE_TYPE::LIST && attr.wait_strategy != WAIT_STRATEGY::BLOCK)
+            std::cerr << name << " warning: the wait strategy needs a ring queue, the LIST queue blocks" << std::endl;
+
+        max_msgs = attr.max_msgs ? attr.max_msgs : 1;
+        double lw = attr.low_watermark < 0.0 ? 0.0 : attr.low_watermark;
+        low_msgs = std::min<size_t>(max_msgs - 1, (size_t)(lw*max_msgs));
+        low_bytes = (size_t)(lw*attr.max_bytes);
+
+        spsc.reset();
+        mpsc.reset();
+        if(q_type == QUEUE_TYPE::RING_SPSC)
+            spsc.reset(new SPSCRing<QEntry>(max_msgs));
+        else if(q_type == QUEUE_TYPE::RING_MPSC)
+            mpsc.reset(new MPSCRing<QEntry>(max_msgs));
+        q_bytes = 0;
+    }
+
+    // the queue with 'n' messages of 'bytes' total payload can't accept 'sz' bytes more
+    bool is_full(size_t n, size_t bytes, size_t sz) const {
+        if(n >= max_msgs) return true;
+        return attr.max_bytes && bytes && bytes + sz > attr.max_bytes;
+    }
+
+    // the queue was drained down to the low watermark
+    bool is_low(size_t n, size_t bytes) const {
+        return n <= low_msgs && (!attr.max_bytes || bytes <= low_bytes);
+    }
+
+    void clear_queue(){
+        size_t n = 0;
+        {
+            std::unique_lock<std::mutex> lck(local_state_mtx);
+            n += in.size();
+            in.clear();
+            in_bytes = 0;
+        }
+        {
+            std::unique_lock<std::mutex> lck(lane_mtx());
+            if(take_mailbox_locked()) n++;
+            n += ctl.size();
+            ctl.clear();
+            ctl_size = 0;
+        }
+        if(q_type != QUEUE_TYPE::LIST){
+            QEntry val;
+            while(ring_pop(val)) n++;
+            q_bytes = 0;
+        }
+        if(n) stats.drop(DROP_REASON::STOPPED, n);
+    }
+
+    // release producers blocked on a full queue of the node that was stopped
+    void wake_all(){
+        {
+            std::unique_lock<std::mutex> lck(local_state_mtx);
+            event.notify_all();
+        }
+        {
+            std::unique_lock<std::mutex> lck(drain_mtx);
+            drain_cv.notify_all();
+        }
+        std::unique_lock<std::mutex> lck(ring_mtx);
+        ring_cv.notify_all();
+    }
+
+    // the data queue looks empty, wake wait_drained if anybody waits
+    void drained(){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(drain_waiters.load(std::memory_order_relaxed) > 0){
+            std::unique_lock<std::mutex> lck(drain_mtx);
+            drain_cv.notify_all();
+        }
+    }
+
+    //*************** LOCK-FREE INPUT QUEUE ***************
+
+    bool ring_push(QEntry& val){
+        if(q_type != QUEUE_TYPE::RING_SPSC) return mpsc->try_push(val);
+
+        // the producer side of the SPSC ring is guarded, so a thread that is not
+        // the upstream node (main, a timer) can still put into the node
+        while(spsc_push.exchange(true, std::memory_order_acquire)) ring_detail::cpu_relax();
+        bool ret_val = spsc->try_push(val);
+        spsc_push.store(false, std::memory_order_release);
+        return ret_val;
+    }
+
+    bool ring_pop(QEntry& val){
+        return q_type == QUEUE_TYPE::RING_SPSC ? spsc->try_pop(val) : mpsc->try_pop(val);
+    }
+
+    size_t ring_size() const {
+        return q_type == QUEUE_TYPE::RING_SPSC ? spsc->size() : mpsc->size();
+    }
+
+    bool reserve_and_push(QEntry& val, size_t sz){
+        q_bytes += sz;
+        if(ring_push(val)) return true;
+        q_bytes -= sz;
+        return false;
+    }
+
+    bool put_ring(tPtrIn& val, size_t sz, QUEUE_POLICY pol, EdgeStats::Slot& edge, uint64_t stale_ns,
+                  const FlowOut& flow){
+        QEntry e{move(val), stale_ns};
+
+        // the bytes are reserved before the push, so the consumer never
+        // subtracts the payload that was not added yet
+        uint64_t t0 = 0;
+        bool worker = WorkStealingPool::in_worker();
+        unsigned rounds = 0;
+        while(is_full(ring_size(), q_bytes, sz) || !reserve_and_push(e, sz)){
+            // RING_SPSC: a sender that was not connected with set_target, it's message is dropped
+            if(pol == QUEUE_POLICY::DROP_OLDEST && q_type == QUEUE_TYPE::RING_MPSC){
+                // the head could be not published yet by the other producer
+                if(!evict_oldest_ring()) std::this_thread::yield();
+                continue;
+            }
+            if(pol != QUEUE_POLICY::WAIT){
+                stats.drop(DROP_REASON::QUEUE_FULL);
+                edge.drops.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            if(!t0) t0 = stats_now_ns();
+
+            // the pool worker shell not block, see WorkStealingPool::help
+            if(!worker || !help_pool(rounds)){
+                // WAIT policy: sleep until the consumer drains the queue down to the
+                // low watermark, the consumer takes the mutex only if it sees a registered waiter
+                std::unique_lock<std::mutex> lck(ring_mtx);
+                auto pred = [this]{return is_low(ring_size(), q_bytes) || !v_running;};
+                prod_waiters++;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(worker) ring_cv.wait_for(lck, std::chrono::milliseconds(1), pred);
+                else ring_cv.wait(lck, pred);
+                prod_waiters--;
+            }
+
+            if(!v_running){
+                stats.drop(DROP_REASON::NOT_RUNNING);
+                return true;
+            }
+        }
+        if(t0) block_done(t0);
+
+        stats.depth(ring_size());
+        accepted(edge, flow);
+
+        // wake the consumer only if it is sleeping (or is going to)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(cons_waiting.load(std::memory_order_relaxed)){
+            std::unique_lock<std::mutex> lck(ring_mtx);
+            ring_cv.notify_all();
+        }
+
+        schedule();
+        return true;
+    }
+
+    //*************** COMMAND LANE ***************
+
+    // the commands are kept apart from the data and are never refused
+    bool put_ctl(tPtrIn& val, EdgeStats::Slot& edge){
+        {
+            std::unique_lock<std::mutex> lck(lane_mtx());
+            ctl.push_back(move(val));
+            ctl_size++;
+            notify_consumer_locked();
+        }
+
+        stats.msgs_in.fetch_add(1, std::memory_order_relaxed);
+        edge.msgs.fetch_add(1, std::memory_order_relaxed);
+        schedule();
+        return true;
+    }
+
+    // lane_mtx() shell be locked
+    bool pop_ctl_locked(tPtrIn& val){
+        if(ctl.empty()) return false;
+        val = move(ctl.front());
+        ctl.pop_front();
+        ctl_size--;
+        return true;
+    }
+
+    tPtrIn pull_ring(bool wait){
+        while(1){
+            tPtrIn val;
+            QEntry e;
+            bool from_ctl = false, from_ring = false;
+
+            if(ctl_size > 0){
+                std::unique_lock<std::mutex> lck(ring_mtx);
+                from_ctl = pop_ctl_locked(val);
+            }
+            if(from_ctl) return val;
+            from_ring = ring_pop(e);
+
+            if(!from_ring){
+                // the mailbox is served after the queue
+                if(has_mail){
+                    std::unique_lock<std::mutex> lck(ring_mtx);
+                    val = take_mailbox_locked();
+                    if(val) return val;
+                }
+                if(!wait) return nullptr;
+
+                // poll before sleeping, see WAIT_STRATEGY
+                if(attr.wait_strategy != WAIT_STRATEGY::BLOCK && spin_for_input()) continue;
+
+                uint64_t t0 = SpanTracer::enabled() ? stats_now_ns() : 0;
+                std::unique_lock<std::mutex> lck(ring_mtx);
+                cons_waiting = true;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool ready = wait_input(ring_cv, lck, [&]{
+                    from_ctl = pop_ctl_locked(val);
+                    if(!from_ctl) from_ring = ring_pop(e);
+                    if(!from_ctl && !from_ring) val = take_mailbox_locked();
+                    return from_ctl || from_ring || val;
+                });
+                cons_waiting = false;
+                lck.unlock();
+                wait_done(t0);
+                if(!ready || !from_ring) return val;
+            }
+
+            // a slot was freed, wake the producers if any of them is waiting
+            // and the low watermark is reached
+            q_bytes -= e.msg->payload_size();
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(prod_waiters.load(std::memory_order_relaxed) > 0 && is_low(ring_size(), q_bytes)){
+                std::unique_lock<std::mutex> lck(ring_mtx);
+                ring_cv.notify_all();
+            }
+
+            val = fresh(e);
+            if(val) return val;
+        }
+    }
+
+    /*
+     * Spin until something is queued (true) or the budget of SPIN_PARK is spent
+     * (false). The producers do not notify a spinning consumer, cons_waiting is
+     * set only when it goes to sleep. The yield lets a producer that shares the
+     * core run, on an own core it returns at once.
+     */
+    bool spin_for_input(){
+        bool poll = attr.wait_strategy == WAIT_STRATEGY::BUSY_POLL;
+        uint64_t t0 = stats_now_ns();
+        uint64_t until = t0 + std::chrono::duration_cast<std::chrono::nanoseconds>(attr.spin_budget).count();
+
+        for(uint32_t i = 1; ; i++){
+            if(ring_size() > 0 || ctl_size > 0 || has_mail){
+                if(SpanTracer::enabled()) wait_done(t0);
+                return true;
+            }
+            ring_detail::cpu_relax();
+            if(i % 256 == 0){
+                auto now = stats_now_ns();
+                if(!poll && now > until) return false;
+                if(deadline_ns && now >= deadline_ns) return false;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    size_t pull_ring_batch(std::vector<tPtrIn>& batch, size_t max, bool wait){
+        auto first = pull_ring(wait);
+        if(!first) return 0;
+
+        batch.push_back(move(first));
+        if(is_control(batch.back())) return 1;
+
+        // the rest of the batch is taken without waiting, the ring holds only the data
+        size_t n = 1, bytes = 0;
+        QEntry e;
+        while(n < max && ring_pop(e)){
+            bytes += e.msg->payload_size();
+            auto val = fresh(e);
+            if(!val) continue;
+            batch.push_back(move(val));
+            n++;
+        }
+
+        if(bytes){
+            q_bytes -= bytes;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(prod_waiters.load(std::memory_order_relaxed) > 0 && is_low(ring_size(), q_bytes)){
+                std::unique_lock<std::mutex> lck(ring_mtx);
+                ring_cv.notify_all();
+            }
+        }
+        return n;
+    }
+
 protected:
     // the main mutex is accessible from any child class
     // so the sincrinization never breaks
@@ -212,9 +1086,58 @@ protected:
 
 private:
     std::thread own_thread;
-    std::list<tPtrIn> in;
+    std::promise<void> started;
+    std::future<void> started_f;
+
+    std::list<QEntry> in;
     std::condition_variable event;
-    bool v_running = false;
+
+    // payload bytes in the 'in' list and the number of producers blocked on it
+    size_t in_bytes = 0;
+    int in_waiters = 0;
+
+    // see set_deadline, it is used by the node thread only
+    uint64_t deadline_ns = 0;
+
+    // queue limits evaluated from 'attr' when the node starts
+    size_t max_msgs = 11;
+    size_t low_msgs = 10;
+    size_t low_bytes = 0;
+    std::atomic<bool> v_running{false};
+
+    // the queue type that is really used, AUTO is resolved in init_queue
+    QUEUE_TYPE q_type = QUEUE_TYPE::LIST;
+
+    // lock-free input queue, only one of them is allocated
+    std::unique_ptr<SPSCRing<QEntry>> spsc;
+    std::unique_ptr<MPSCRing<QEntry>> mpsc;
+    std::atomic<bool> spsc_push{false};
+
+    // the single-slot mailbox of COALESCE_LATEST, guarded by lane_mtx()
+    tPtrIn mailbox;
+    std::atomic<bool> has_mail{false};
+
+    // the command lane, it is served before the data, guarded by lane_mtx()
+    std::list<tPtrIn> ctl;
+    std::atomic<size_t> ctl_size{0};
+
+    // the slow path of the ring queue: sleeping producers and consumer
+    std::mutex ring_mtx;
+    std::condition_variable ring_cv;
+    std::atomic<bool> cons_waiting{false};
+    std::atomic<size_t> q_bytes{0};
+
+    // the node runs as a task of the WorkStealingPool and it is
+    // submitted to (or is running on) the pool now
+    std::atomic<bool> pooled{false};
+    std::atomic<bool> scheduled{false};
+    std::vector<tPtrIn> slice_batch;
+    std::atomic<int> prod_waiters{0};
+
+    // see wait_drained
+    std::mutex drain_mtx;
+    std::condition_variable drain_cv;
+    std::atomic<int> drain_waiters{0};
 };
 
 #endif //DISTPIPELINEFWK_BASE_NODE_HPP_H
@@ -33,15 +33,24 @@ protected:
                QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "BaseSource"):
             tBase(name),
             func_acquire{func_acquire},
-            pol(pol) {}
+            pol(pol),
+            emit_origin{(uint64_t)NodeFactory::next_msg_origin() << NodeFactory::msg_seq_bits} {}
 
     virtual bool process_usr_msg(tPtrIn&& msg){
         if(next && func_acquire){
             if(msg->cmd == MSG_CMD::ACQUIRE) {
                 tPtrOut out_msg = func_acquire();
                 out_msg->sent_from = this->uid;
+                stamp(*out_msg);
+
+                // the message is created here, the first hop has no queueing
+                if(attr.trace_start){
+                    out_msg->trace = std::make_shared<TraceHop>(nullptr, this->uid, stats_now_ns());
+                    out_msg->trace->deq_ns = out_msg->trace->enq_ns;
+                }
                 return next->put(move(out_msg), this->uid, pol);
             }
+            return true;
         }else{
             std::cerr << name << " broken pipe" << std::endl;
             return false;
@@ -49,9 +58,23 @@ protected:
     };
 
 public:
-    void set_target(tPtrNext target){next = target;}
+    void set_target(tPtrNext target){
+        next = target;
+        if(next) next->reg_upstream(this, pol);
+    }
 
 protected:
+    /*
+     * The UID of an emitted message: the origin of this source and the number
+     * of the messages emitted so far. So a gap in the sequence of the messages
+     * of one origin is a message lost between the source and the receiver, in
+     * this process or behind an edge to the other one. A source with it's own
+     * main_loop shell call it for each message it sends.
+     */
+    void stamp(tOut& msg){
+        msg.set_uid(emit_origin | (++emit_seq & NodeFactory::msg_seq_mask));
+    }
+
     // function to be called each time AQUIRE message was received
     std::function<tPtrOut()> func_acquire;
 
@@ -61,6 +84,11 @@ protected:
     // the policy to be used when this node is sending
     // a new message to the "next" node, can be WAIT or DROP
     QUEUE_POLICY pol;
+
+private:
+    // see stamp
+    uint64_t emit_origin;
+    uint64_t emit_seq = 0;
 };
 
 #endif //DISTPIPELINEFWK_BASE_SOURCE_H
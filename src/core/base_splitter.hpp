@@ -33,22 +33,52 @@ public:
      * If output policy is DROP, the packets will
      * not synchronize between the output channels, that can be important
      * in the case of parallel computations.
+     *
+     * By default each target receives it's own copy of the message. With
+     * share_payload = true all targets receive the same message object, so
+     * splitting a large frame costs only a reference count increment. The
+     * message is copied later, only by the nodes that modify it (see
+     * make_writable), all DSP filters and BaseFilter do it. Custom nodes and
+     * filter functions behind this splitter shell do the same. The traced
+     * messages (see msg_trace.h) are always copied.
+     *
+     * A message that is already shared by the upstream splitter can't be
+     * written, so with share_payload it is forwarded as is and keeps the
+     * sent_from of the splitter that has shared it (a BaseSyncJoin behind
+     * this splitter shell register that one). Without share_payload each
+     * target receives a copy with it's own sent_from.
      */
 protected:
     friend class NodeFactory;
-    BaseSplitter(QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "BaseSplitter"):
+    BaseSplitter(QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "BaseSplitter",
+                 bool share_payload = false):
             tBase(name),
+            share_payload{share_payload},
             pol{pol} {}
 
     virtual bool process_usr_msg(tPtrIn&& msg){
         if(!targets.empty()){
+            // a traced message gets a new hop in each target, so it is never shared
+            bool share = share_payload && !msg->trace;
+
+            // the message of the upstream splitter is not written here, see above
+            bool upstream_shared = msg->shared;
+            if(!upstream_shared) make_writable(msg);
+
+            unsigned int from = this->uid;
+            if(share){
+                if(upstream_shared) from = msg->sent_from;
+                else msg->shared = true;
+            }
+
             for(auto it = targets.begin(); it != targets.end(); it++) {
                 bool ret_val;
                 if(it != --targets.end()){
-                    auto cpy_msg = tPtrIn(new typename tPtrIn::element_type(*msg));
-                    ret_val = (*it)->put(move(cpy_msg), this->uid, pol);
+                    auto cpy_msg = share ? msg : tPtrIn(new typename tPtrIn::element_type(*msg));
+                    ret_val = (*it)->put(move(cpy_msg), from, pol);
                 }else{
-                    ret_val = (*it)->put(move(msg), this->uid, pol);
+                    if(!share && upstream_shared) msg = tPtrIn(new typename tPtrIn::element_type(*msg));
+                    ret_val = (*it)->put(move(msg), from, pol);
                 }
                 if (!ret_val)
                     std::cerr << tBase::name << " warning: target \"" << (*it)->get_name()
@@ -62,12 +92,16 @@ protected:
     };
 
 public:
-    void add_target(tPtrNext target){targets.push_back(target);}
+    void add_target(tPtrNext target){
+        targets.push_back(target);
+        if(target) target->reg_upstream(this, pol);
+    }
 
 private:
-    QUEUE_POLICY pol;
+    bool share_payload;
 
 protected:
+    QUEUE_POLICY pol;
     std::list<tPtrNext> targets;
 };
 
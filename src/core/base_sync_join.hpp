@@ -6,10 +6,11 @@
 #define DISTPIPELINEFWK_BASE_SYNC_JOIN_H
 
 #include <functional>
-#include <deque>
-#include <list>
-#include <algorithm>
-#include <set>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
 
 #include "base_node.hpp"
 
@@ -26,16 +27,54 @@ public:
     using tMsg = std::shared_ptr<BaseMessage>;
     using tPtrMsgBlock = std::shared_ptr<std::map<unsigned int, tMsg>>;
     using tFuncJoin = std::function<tPtrOut(tPtrMsgBlock&&)>;
-    using MsgDeque = std::deque<tPtrIn>;
     using tPtrNext = std::shared_ptr<BaseNode<tOut>>;
 
+    /*
+     * The messages that wait for their pairs from the other channels are kept
+     * in a bounded table. An incomplete entry is evicted when:
+     *
+     * 1. the table is full and a message with a new UID arrives (the oldest entry
+     * is evicted), max_pending limits the memory used by the join;
+     *
+     * 2. it is older than max_age (zero - no limit), the node wakes up when the
+     * oldest entry expires even if no messages arrive (in the pool mode it is
+     * checked only when the node runs, see BaseNode::set_deadline);
+     *
+     * 3. a newer message was joined. All channels are FIFO, so the older message
+     * can't be completed anymore - it was lost in one of the channels.
+     *
+     * By default the evicted messages are discarded. With emit_partial = true
+     * the join function is called with an incomplete message block (only the
+     * channels that have delivered their messages are present in it).
+     */
+    struct JoinPolicy{
+        size_t max_pending = 256;
+        std::chrono::milliseconds max_age{0};
+        bool emit_partial = false;
+    };
+
 public:
     BaseSyncJoin(tFuncJoin func_join, QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "BaseSyncJoin")
     : tBase(name), func_join{func_join}, pol{pol} {};
 
-    void reg_source_uid(unsigned int src_uid){ src_list.push_back(src_uid); }
+    void reg_source_uid(unsigned int src_uid){
+        src_idx[src_uid] = src_list.size();
+        src_list.push_back(src_uid);
+
+        // the table is reallocated for the new number of channels
+        entries.clear();
+    }
+
+    // it shell be called before the first message arrives
+    void set_join_policy(const JoinPolicy& p){
+        policy = p;
+        entries.clear();
+    }
 
-    void set_target(tPtrNext target){ next = target; }
+    void set_target(tPtrNext target){
+        next = target;
+        if(next) next->reg_upstream(this, pol);
+    }
 
     /*
      * Class BaseSyncJoin can receive messages of any type derived from BaseMessage,
@@ -64,6 +103,10 @@ protected:
      * and SyncJoin nodes;
      * 2. All channels of all input pipes are FIFO. In the opposite case
      * the data loss will rise significantly.
+     *
+     * Each message is matched by it's UID in a hash table, so the join cost does not
+     * depend on the number of channels and pending messages, and there are no
+     * allocations per message: the table is allocated once (see JoinPolicy).
      */
 
     virtual bool process_usr_msg(tPtrIn&& msg_in){
@@ -82,80 +125,228 @@ protected:
             return false;
         }
 
-        if(std::find(src_list.begin(), src_list.end(), msg_in->sent_from) != src_list.end()) {
+        // messages from unregistered sources are ignored
+        auto src = src_idx.find(msg_in->sent_from);
+        if(src == src_idx.end()) return true;
+
+        if(entries.empty()) init_table();
+
+        auto now = std::chrono::steady_clock::now();
+        bool ret_val = expire(now);
+
+        auto msg_uid = msg_in->get_uid();
+        int e = find(msg_uid);
+        if(e < 0){
+            ret_val = alloc(msg_uid, now, e) && ret_val;
+        }
+
+        auto& en = entries[e];
+        if(!en.slots[src->second]) en.n++;
+        en.slots[src->second] = std::move(msg_in);
 
-            auto msg_uid = msg_in->get_uid();
+        // check joinable condition
+        if(en.n == src_list.size()){
+            // all messages that arrived before joining point will never be completed (FIFO property)
+            while(head != e)
+                ret_val = evict(head) && ret_val;
 
-            // collect messages
-            msg_sets[msg_uid].insert(msg_in->sent_from);
-            queues[msg_in->sent_from].push_back(msg_in);
+            ret_val = emit(e) && ret_val;
+        }
 
-            // check joinable condition
-            if (msg_sets[msg_uid].size() == src_list.size()) {
+        arm_deadline();
+        return ret_val;
+    };
 
-                // create new message block to be sent to the next node
-                auto msg_block = tPtrMsgBlock(new typename tPtrMsgBlock::element_type());
+    // the oldest pending entry has expired and no message has arrived since
+    virtual void on_deadline(){
+        if(!expire(std::chrono::steady_clock::now()))
+            std::cerr << name << " warning: failed to emit an expired join" << std::endl;
+        arm_deadline();
+    }
 
-                // remove old messages from all queues the msg_sets and fill MsgBlock
-                for(auto& kv_queues : queues){
+private:
+    struct Entry{
+        uint64_t uid;
+        // number of the received messages
+        size_t n = 0;
+        // received messages, indexed by the source number
+        std::vector<tMsg> slots;
+        // arrival time of the first message
+        std::chrono::steady_clock::time_point t0;
+        // the list of entries in the arrival order
+        int prev = -1;
+        int next = -1;
+    };
 
-                    auto& msg_queue = kv_queues.second;
+    void init_table(){
+        size_t cap = policy.max_pending ? policy.max_pending : 1;
 
-                    // all messages that arrived before joining point can be removed (FIFO property)
-                    // both from the msg_sets...
-                    MsgDeque::iterator old_it = msg_queue.begin();
-                    while((*old_it)->get_uid() != msg_uid){
-                        msg_sets.erase((*old_it)->get_uid());
-                        old_it++;
-                    }
+        entries.assign(cap, Entry());
+        free_list.clear();
+        for(size_t i = cap; i > 0; i--){
+            entries[i-1].slots.resize(src_list.size());
+            free_list.push_back((int)i - 1);
+        }
 
-                    // add message to msg_block
-                    (*msg_block)[kv_queues.first] = *old_it;
+        // open addressing index, it is kept at most half full
+        size_t sz = 2;
+        bits = 1;
+        while(sz < 2*cap){
+            sz <<= 1;
+            bits++;
+        }
+        index.assign(sz, -1);
+        head = tail = -1;
+    }
 
-                    // ... and removed from the queues
-                    msg_queue.erase(msg_queue.begin(), old_it + 1);
-                }
+    size_t home(uint64_t uid) const {
+        return (size_t)((uid * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+    }
 
-                // erase joined message from msg_sets
-                msg_sets.erase(msg_uid);
+    int find(uint64_t uid) const {
+        size_t mask = index.size() - 1;
+        for(size_t h = home(uid); index[h] >= 0; h = (h + 1) & mask)
+            if(entries[index[h]].uid == uid) return index[h];
+        return -1;
+    }
 
-                // store attached data from the message that arrived from the first pipe
-                // added to src_list
-                BaseMessage tmp(*msg_block->at(*src_list.begin()));
+    // take a free entry for the new UID, the oldest one is evicted if there is no space
+    bool alloc(uint64_t uid, std::chrono::steady_clock::time_point now, int& e){
+        bool ret_val = true;
+        if(free_list.empty()) ret_val = evict(head);
 
-                // call joining function, only user knows how to join data from different pipes
-                auto out_msg = func_join(move(msg_block));
-                if(!out_msg) return true;
+        e = free_list.back();
+        free_list.pop_back();
 
-                // atomatically manage attached data to be sure that at least
-                // msg UID will be kept correct for the newly created out_msg
-                if(out_msg->keep_prev_attached_data) {
-                    out_msg->init_attached_data(tmp);
-                }else{
-                    out_msg->keep_prev_attached_data = true;
-                }
+        auto& en = entries[e];
+        en.uid = uid;
+        en.n = 0;
+        en.t0 = now;
 
-                return next->put(func_join(move(msg_block)), this->uid, pol);
-            }
+        size_t mask = index.size() - 1;
+        size_t h = home(uid);
+        while(index[h] >= 0) h = (h + 1) & mask;
+        index[h] = e;
+
+        // append to the arrival order list
+        en.prev = tail;
+        en.next = -1;
+        if(tail >= 0) entries[tail].next = e; else head = e;
+        tail = e;
+
+        return ret_val;
+    }
+
+    void release(int e){
+        auto& en = entries[e];
+        for(auto& m : en.slots) m = nullptr;
+        en.n = 0;
+
+        // unlink from the arrival order list
+        if(en.prev >= 0) entries[en.prev].next = en.next; else head = en.next;
+        if(en.next >= 0) entries[en.next].prev = en.prev; else tail = en.prev;
+
+        // remove from the index, the following entries of the probe sequence are shifted back
+        size_t mask = index.size() - 1;
+        size_t p = home(en.uid);
+        while(index[p] != e) p = (p + 1) & mask;
+        index[p] = -1;
+        for(size_t q = (p + 1) & mask; index[q] >= 0; q = (q + 1) & mask){
+            size_t k = home(entries[index[q]].uid);
+            bool stays = p <= q ? (p < k && k <= q) : (p < k || k <= q);
+            if(stays) continue;
+            index[p] = index[q];
+            index[q] = -1;
+            p = q;
         }
 
+        free_list.push_back(e);
+    }
+
+    // drop an incomplete entry or emit it as a partial join
+    bool evict(int e){
+        if(policy.emit_partial && entries[e].n > 0)
+            return emit(e);
+
+        stats.drop(DROP_REASON::EVICTED, entries[e].n);
+        release(e);
         return true;
-    };
+    }
+
+    bool expire(std::chrono::steady_clock::time_point now){
+        bool ret_val = true;
+        if(policy.max_age.count() == 0) return ret_val;
+
+        while(head >= 0 && now - entries[head].t0 >= policy.max_age)
+            ret_val = evict(head) && ret_val;
+        return ret_val;
+    }
+
+    // wake up when the oldest pending entry expires
+    void arm_deadline(){
+        if(policy.max_age.count() == 0) return;
+        if(head < 0){
+            set_deadline(0);
+            return;
+        }
+
+        using namespace std::chrono;
+        auto t = entries[head].t0 + policy.max_age;
+        set_deadline((uint64_t)duration_cast<nanoseconds>(t.time_since_epoch()).count());
+    }
+
+    bool emit(int e){
+        // create new message block to be sent to the next node
+        auto msg_block = tPtrMsgBlock(new typename tPtrMsgBlock::element_type());
+
+        // store attached data from the message that arrived from the first pipe
+        // added to src_list (the first present one for a partial join)
+        tMsg first;
+
+        auto& en = entries[e];
+        for(size_t i = 0; i < src_list.size(); i++){
+            if(!en.slots[i]) continue;
+            if(!first) first = en.slots[i];
+            (*msg_block)[src_list[i]] = std::move(en.slots[i]);
+        }
+        release(e);
+        BaseMessage tmp(*first);
+
+        // call joining function, only user knows how to join data from different pipes
+        auto out_msg = func_join(std::move(msg_block));
+        if(!out_msg) return true;
+
+        // atomatically manage attached data to be sure that at least
+        // msg UID will be kept correct for the newly created out_msg
+        if(out_msg->keep_prev_attached_data) {
+            out_msg->inherit_attached_data(tmp);
+        }else{
+            out_msg->keep_prev_attached_data = true;
+        }
+
+        return next->put(std::move(out_msg), this->uid, pol);
+    }
 
 private:
 
-    // key is the source uid, value is it's local input deque
-    std::map<unsigned int, MsgDeque> queues;
+    // the pending table: entries, free entries and the uid index
+    std::vector<Entry> entries;
+    std::vector<int> free_list;
+    std::vector<int> index;
+    size_t bits = 1;
 
-    // key is the message uid, value is source uid from
-    // where the message with the same uid was already received
-    std::map<unsigned int, std::set<unsigned int>> msg_sets;
+    // the oldest and the newest pending entries
+    int head = -1;
+    int tail = -1;
 
+    JoinPolicy policy;
 
 private:
 
-    // sources (by uid's) that will be considered as joinable
-    std::list<unsigned int> src_list;
+    // sources (by uid's) that will be considered as joinable and their
+    // positions in the src_list
+    std::vector<unsigned int> src_list;
+    std::unordered_map<unsigned int, size_t> src_idx;
 
     // function to be called each time join condition is met
     tFuncJoin func_join;
@@ -18,7 +18,9 @@
  *
  * Each transmitted data shell implement the ICmdData interface to let
  * another nodes, such as "simple_splitter", to copy that data
- * among multiply channels.
+ * among multiply channels. The data is shared by the messages, so it is
+ * const once attached: 'apply' can't change it, a node that needs the other
+ * data takes a private copy (see BaseMessage::mutable_user_data).
  */
 
 
@@ -45,6 +47,7 @@
 
 struct ICloneable{
     using tPtrCloneable = std::shared_ptr<ICloneable>;
+    using tPtrConstCloneable = std::shared_ptr<const ICloneable>;
 
     // override 'clone' in EACH child at any level of inheritance!
     virtual tPtrCloneable clone() const = 0;
@@ -52,9 +55,10 @@ struct ICloneable{
     /*
      * The destination node object will call this function to apply command
      * message on itself in a thread safe manner. Parameter is a pointer to
-     * receiver node object.
+     * receiver node object. The same data can be applied by several nodes
+     * at once, so it is const.
      */
-    virtual void apply(CommandNode* ) = 0;
+    virtual void apply(CommandNode* ) const = 0;
 };
 
 /*
@@ -64,4 +68,29 @@ struct ICloneable{
  * is defined below to be visible by all node implementations.
  */
 
+/*
+ * Change the scheduling attributes (NodeAttr::sched) of a running node. The
+ * commands are forwarded downstream by the filters and splitters, so the
+ * command carries the UID of the node it is addressed to, the other nodes
+ * ignore it:
+ *
+ * SchedAttr s;
+ * s.cpus = {2, 3};
+ * node->put(MSG_CMD::USER, 0, QUEUE_POLICY::WAIT, std::make_shared<SchedCmd>(s, node->get_uid()));
+ */
+struct SchedCmd : public ICloneable{
+    SchedCmd(const SchedAttr& sched, unsigned int node_uid): sched{sched}, node_uid{node_uid} {}
+
+    virtual tPtrCloneable clone() const {
+        return std::shared_ptr<SchedCmd>(new SchedCmd(*this));
+    }
+
+    virtual void apply(CommandNode* ptr) const {
+        if(ptr->get_uid() == node_uid) ptr->set_sched(sched);
+    }
+
+    SchedAttr sched;
+    unsigned int node_uid;
+};
+
 #endif //DISTPIPELINEFWK_CMD_DATA_TYPES_H
@@ -7,6 +7,14 @@
 
 #include <string>
 #include <memory>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+
+#include "node_stats.h"
+#include "thread_sched.h"
 
 /*
  * Command messages are objects of BaseMessage that
@@ -38,18 +46,203 @@ enum class MSG_CMD{ACQUIRE, STOP, NONE, USER};
  *
  * DROP - is used to process the most recent data
  * WAIT - is used to speed down sender and avoid data loss
+ *
+ * The next policies keep the freshest data, they are used on the display and
+ * control paths, where an old frame is worth nothing:
+ *
+ * DROP_OLDEST - the oldest data message of the full queue is discarded and the
+ * new one is accepted. Only the consumer may remove the head of RING_SPSC, so a
+ * node that has an upstream connected with DROP_OLDEST uses RING_MPSC instead
+ * (see QUEUE_TYPE). A sender that was not connected with set_target can't be
+ * known in advance, it's DROP_OLDEST message to a full RING_SPSC is dropped as
+ * with DROP.
+ *
+ * COALESCE_LATEST - the message is put into the single-slot mailbox of the node
+ * and overwrites the one that is still there. The mailbox is served after the
+ * queue, so a slow node sees only the latest message. There is one mailbox per
+ * node, so the policy shell be used by a single sender.
+ *
+ * DROP_STALE - as DROP, in addition the message is discarded when it is dequeued
+ * after it has waited longer than NodeAttr::max_age of the receiver.
+ *
+ * The policies are applied to the data only, the command messages (STOP, USER)
+ * go to the command lane of the node (see QUEUE_TYPE).
+ */
+enum class QUEUE_POLICY{WAIT, DROP, DROP_OLDEST, COALESCE_LATEST, DROP_STALE};
+
+/*
+ * The input queue implementation of a node.
+ *
+ * LIST - std::list protected by a mutex, each message costs a mutex round trip
+ * and a list node allocation. It is unbounded in memory and is the default.
+ *
+ * RING_SPSC - bounded lock-free ring for the case when exactly one thread
+ * sends data to the node (a simple chain). The consumer is wait-free, the
+ * producers take a spin flag for the time of the push (one atomic exchange
+ * when there is no other producer), so an occasional put from a thread that is
+ * not the upstream node (main, a timer) is still safe, it only waits for the
+ * push of the other producer.
+ *
+ * RING_MPSC - bounded lock-free ring that accepts data from any number of
+ * threads, for example a BaseSyncJoin or a node fed by a number of splitters.
+ *
+ * AUTO - RING_SPSC if exactly one upstream node was connected with set_target
+ * or add_target at the moment when the node is started, RING_MPSC otherwise.
+ * NodeFactory::create starts the node at once, before it is connected, so AUTO
+ * gives RING_SPSC only if the graph is started after it is wired: with the
+ * deferred start (NodeFactory::set_deferred_start and start_all) or when the
+ * node is restarted (stop, start) after set_target.
+ *
+ * RING_SPSC (requested or selected by AUTO) is replaced by RING_MPSC when an
+ * upstream node sends with QUEUE_POLICY::DROP_OLDEST.
+ *
+ * Command messages (STOP, USER) never pass through the data queue of any
+ * type: each node keeps them in a separate small locked list, the command
+ * lane. It is unbounded, so a command is never dropped and put never blocks
+ * on it, and it is served before the data, so a reconfiguration does not
+ * wait behind the queued frames. The data that was queued before a STOP is
+ * discarded, use NodeFactory::stop_all(true) to process it first.
+ */
+enum class QUEUE_TYPE{LIST, RING_SPSC, RING_MPSC, AUTO};
+
+/*
+ * How the node thread waits for the input when it's queue is empty.
+ *
+ * BLOCK - sleep on the condition variable at once. The producer pays a futex
+ * wake and the consumer a scheduler wakeup, tens of microseconds per hop, but
+ * an idle node costs nothing. It is the default.
+ *
+ * SPIN_PARK - poll the queue for NodeAttr::spin_budget and then sleep as BLOCK.
+ * A message that arrives during the spin is taken without any system call on
+ * both sides, so the nodes with a steady input keep the hop latency at a few
+ * microseconds and sleep only between the bursts.
+ *
+ * BUSY_POLL - never sleep, poll the queue until a message or a command arrives.
+ * It burns a core even when idle, so it is meant for a node pinned to an own
+ * core (see NodeAttr::sched) on the latency critical path.
+ *
+ * The polling needs a lock-free input queue: the strategy is applied to the
+ * RING_SPSC and RING_MPSC queues (or AUTO), a LIST node always blocks. The pooled
+ * nodes have no thread that could wait, they ignore it.
+ */
+enum class WAIT_STRATEGY{BLOCK, SPIN_PARK, BUSY_POLL};
+
+/*
+ * Where the node code is executed.
+ *
+ * THREAD - the node has it's own thread (the default).
+ *
+ * POOL - the node is a task that is run on the shared work-stealing pool
+ * (see executor.hpp) each time it's input queue is not empty. This mode
+ * is applied only to the nodes that use the default BaseNode::main_loop,
+ * a node that overrides the main_loop (sources) keeps it's own pinned thread.
+ */
+enum class EXEC_MODE{THREAD, POOL};
+
+/*
+ * Node attributes that are not a part of the node algorithm and can
+ * be set for any node at creation time with NodeFactory::create_with.
  */
-enum class QUEUE_POLICY{WAIT, DROP};
+struct NodeAttr{
+    // input queue implementation
+    QUEUE_TYPE queue_type = QUEUE_TYPE::LIST;
+
+    /*
+     * Input queue capacity. The queue is full when it holds max_msgs messages
+     * or when the payload of the queued messages (see BaseMessage::payload_size)
+     * would exceed max_bytes. A message is always accepted by an empty queue,
+     * even if it is larger than max_bytes. Zero max_bytes means no byte limit.
+     *
+     * The default reproduces the historical limit "in.size() > 10". The ring
+     * queues allocate max_msgs rounded up to the power of two slots.
+     */
+    size_t max_msgs = 11;
+    size_t max_bytes = 0;
+
+    /*
+     * Hysteresis for WAIT producers. A producer blocked on a full queue
+     * is woken only when the queue drains down to low_watermark*max_msgs
+     * messages and low_watermark*max_bytes bytes. With 1.0 the producers
+     * are woken as soon as there is room for one message, with 0.5 a
+     * blocked producer waits until the queue is half empty and then can
+     * push a burst without bouncing on each consumed message.
+     */
+    double low_watermark = 1.0;
+
+    // the messages sent with QUEUE_POLICY::DROP_STALE and waiting in the input
+    // queue longer than max_age are discarded, zero - they are never stale
+    std::chrono::microseconds max_age{0};
+
+    /*
+     * The default main_loop drains up to batch_size messages from the input
+     * queue at once and passes them to BaseNode::process_usr_batch. One means
+     * one message per wakeup (process_usr_msg), as it was always done. Zero
+     * leaves the choice to the node: one message for the most of them, a node
+     * that gains from the batches (e.g. RemoteSink) sets it's own default.
+     */
+    size_t batch_size = 0;
+
+    /*
+     * EXEC_MODE::POOL: the number of batches (or single messages) a node
+     * processes in one run of it's pool task before it yields the worker to
+     * the other nodes. A larger slice costs less rescheduling, a smaller one
+     * gives the other pooled nodes a shorter latency.
+     */
+    size_t pool_slice = 16;
+
+    // see WAIT_STRATEGY, the budget is the spin time of SPIN_PARK before it sleeps
+    WAIT_STRATEGY wait_strategy = WAIT_STRATEGY::BLOCK;
+    std::chrono::microseconds spin_budget{50};
+
+    // own thread or the shared pool
+    EXEC_MODE exec_mode = EXEC_MODE::THREAD;
+
+    /*
+     * Message latency tracing (see msg_trace.h). The node with trace_start
+     * begins a new trace for each message it receives (or creates, in the case
+     * of BaseSource), the node with trace_sink adds the traces of the received
+     * messages into TraceAggregator::global().
+     */
+    bool trace_start = false;
+    bool trace_sink = false;
+
+    /*
+     * CPU affinity, scheduling policy and NUMA node of the node thread (see
+     * thread_sched.h). They are applied by the node thread before main_loop,
+     * and can be changed later with the SchedCmd command. The pooled nodes
+     * have no own thread, so they ignore it.
+     */
+    SchedAttr sched;
+};
 
 class NodeFactory;
 class ICloneable;
+struct SchedCmd;
 
 struct CommandNode{
     CommandNode(std::string name): name{name}{};
 
     virtual void start() = 0;
     virtual void stop() = 0;
-    virtual bool put(MSG_CMD, unsigned int sent_from, QUEUE_POLICY, std::shared_ptr<ICloneable>&& ) = 0;
+
+    /*
+     * The two halves of start and stop, so a number of nodes can be started
+     * (or stopped) in parallel, see NodeFactory::start_all and stop_all.
+     * start_async launches the node thread, wait_started returns when it is
+     * running. stop_async sends the STOP command, wait_stopped joins the thread.
+     */
+    virtual void start_async() = 0;
+    virtual void wait_started() = 0;
+    virtual void stop_async() = 0;
+    virtual void wait_stopped() = 0;
+    virtual bool is_running() = 0;
+    virtual bool put(MSG_CMD, unsigned int sent_from, QUEUE_POLICY, std::shared_ptr<const ICloneable>&& ) = 0;
+
+    // the number of messages in the input queue
+    virtual size_t queue_size() = 0;
+
+    // wait until the input queue is empty or the node is stopped
+    virtual void wait_drained() = 0;
 
     // used to down-cast pointers from CommandNode* to ConcreteNode*
     virtual ~CommandNode() {};
@@ -62,14 +255,53 @@ protected:
     // can be safely used for debug purposes
     std::string name;
 
+    // node attributes, they are applied when the node starts
+    NodeAttr attr;
+
+    // apply NodeAttr::sched to the node thread, it is called from the node thread
+    friend struct SchedCmd;
+    virtual void set_sched(const SchedAttr& sched) = 0;
+
 private:
-    // the UID can be set by NodeFactory only
+    // the UID and attributes can be set by NodeFactory only
     friend class NodeFactory;
     void set_uid(unsigned int uid){this->uid = uid;}
+    void set_attr(const NodeAttr& attr){this->attr = attr;}
 
 public:
     unsigned int get_uid(){return uid;}
     std::string get_name(void){return name;}
+
+    /*
+     * Each node that connects itself to this one with set_target or add_target
+     * registers here. The number of upstream nodes is used to select the
+     * input queue type when QUEUE_TYPE::AUTO is requested, the UIDs define the
+     * start and stop order of NodeFactory::start_all and stop_all. 'pol' is the
+     * policy the upstream node sends with, DROP_OLDEST rules out RING_SPSC.
+     */
+    void reg_upstream(CommandNode* from, QUEUE_POLICY pol){
+        n_upstream++;
+        if(pol == QUEUE_POLICY::DROP_OLDEST) drop_oldest_upstream = true;
+        std::unique_lock<std::mutex> lck(links_mtx);
+        upstream.push_back(from->uid);
+    }
+
+    std::vector<unsigned int> get_upstream(){
+        std::unique_lock<std::mutex> lck(links_mtx);
+        return upstream;
+    }
+
+    // runtime metrics, see node_stats.h and NodeFactory::stats_snapshot
+    const NodeStats& get_stats() const {return stats;}
+
+protected:
+    std::atomic<unsigned int> n_upstream{0};
+    std::atomic<bool> drop_oldest_upstream{false};
+    NodeStats stats;
+
+private:
+    std::mutex links_mtx;
+    std::vector<unsigned int> upstream;
 };
 
 #endif //DISTPIPELINEFWK_COMMAND_NODE_H
@@ -8,9 +8,15 @@
 #include <memory>
 #include <exception>
 #include <vector>
+#include <atomic>
+#include <string>
+#include <typeinfo>
+#include <type_traits>
 
 #include "cmd_data_types.h"
 #include "node_factory.hpp"
+#include "msg_trace.h"
+#include "serialization.h"
 
 struct BaseMessage {
     /*
@@ -18,14 +24,14 @@ struct BaseMessage {
      * in the new object manually.
      */
     BaseMessage() {
-        uid = NodeFactory::generate_random_uid();
+        uid = NodeFactory::next_msg_uid();
     }
 
     /*
      * Simplified constructor for command messages.
      */
     BaseMessage(MSG_CMD cmd) : cmd{cmd} {
-        uid = NodeFactory::generate_random_uid();
+        uid = NodeFactory::next_msg_uid();
     }
 
     /*
@@ -47,12 +53,14 @@ struct BaseMessage {
     /*
      * In the case when newly created message shell keep attached data of the
      * other message, and they have different data types - use this function.
-     * It is especially important to preserve the message UID.
+     * It is especially important to preserve the message UID. The user_data
+     * is not copied, both messages refer to the same object (see mutable_user_data).
      */
 
     void init_attached_data(const BaseMessage& msg){
         this->cmd = msg.cmd;
-        this->user_data = msg.user_data ? msg.user_data->clone() : nullptr;
+        this->user_data = msg.user_data;
+        this->trace = msg.trace;
         this->uid = msg.uid;
     }
 
@@ -60,11 +68,79 @@ struct BaseMessage {
      * Each message have a unique identifier. It is used in BaseSyncJoin.
      * When the message is splitted, it's uid is cloned. So that BaseSyncJoin
      * could identify joinable messages which came from different channels.
+     * The UID is the origin and the sequence number (see NodeFactory::next_msg_uid).
      */
-    unsigned int get_uid(){
+    uint64_t get_uid(){
         return uid;
     }
 
+    static uint16_t uid_origin(uint64_t uid){
+        return (uint16_t)(uid >> NodeFactory::msg_seq_bits);
+    }
+
+    static uint64_t uid_seq(uint64_t uid){
+        return uid & NodeFactory::msg_seq_mask;
+    }
+
+    /*
+     * The transports that deliver a message from the other process restore
+     * it's UID, so the joins and traces still match it, and a source stamps it's
+     * output (see BaseSource::stamp). Do not use it otherwise.
+     */
+    void set_uid(uint64_t uid){
+        this->uid = uid;
+    }
+
+    /*
+     * The size of the message data in bytes. It is used by BaseNode to limit
+     * the input queue memory (see NodeAttr::max_bytes), so the messages that
+     * carry large frames shell override it. Zero means "not accounted".
+     */
+    virtual size_t payload_size() const {
+        return 0;
+    }
+
+    /*
+     * init_attached_data for the output of a node, 'prev' is the input as it was
+     * received. The user_data that was attached or changed in the node (see
+     * mutable_user_data) is kept, the rest is taken from 'prev'.
+     */
+    void inherit_attached_data(const BaseMessage& prev){
+        auto own = user_data != prev.user_data ? std::move(user_data) : nullptr;
+        init_attached_data(prev);
+        if(own) user_data = std::move(own);
+    }
+
+    /*
+     * The user_data is shared by all messages derived from this one (the output
+     * messages of the filters, the copies made by the splitters), so it is const
+     * and is passed along the chain without a copy. A node that changes it takes
+     * a private copy with this function, the copy replaces the data of this
+     * message only. Each call makes a new copy, keep the returned pointer.
+     */
+    std::shared_ptr<ICloneable> mutable_user_data(){
+        if(!user_data) return nullptr;
+        auto cpy = user_data->clone();
+        user_data = cpy;
+        return cpy;
+    }
+
+    /*
+     * Brings a released message to the state of a newly constructed one, so it
+     * can be reused (see MsgPool). The attached data is dropped, the new UID is
+     * given by MsgPool::acquire in the thread that takes the message, so it is in
+     * the sequence of that thread. The derived classes shell clear their payload
+     * without releasing the memory and call this function.
+     */
+    virtual void recycle(){
+        cmd = MSG_CMD::NONE;
+        user_data = nullptr;
+        keep_prev_attached_data = true;
+        sent_from = 0;
+        shared = false;
+        trace = nullptr;
+    }
+
     /*
      * A command attached to a message. See cmd_data_types.h for
      * details.
@@ -76,9 +152,10 @@ struct BaseMessage {
      * a specific command that can be recognized by the target of
      * this data. It can be used as a command data for any filter. For example,
      * the filter is already created, but during the program execution
-     * some of it's parameters need an update.
+     * some of it's parameters need an update. It shell not be changed in place,
+     * see mutable_user_data.
      */
-    std::shared_ptr<ICloneable> user_data = nullptr;
+    std::shared_ptr<const ICloneable> user_data = nullptr;
 
     /*
      * Each time the message passes through any filter,
@@ -98,14 +175,48 @@ struct BaseMessage {
      */
     unsigned int sent_from = 0;
 
+    /*
+     * The message is delivered to several nodes as the same object by a
+     * BaseSplitter with the shared payload. It is not copied with the message
+     * and is cleared by make_writable.
+     */
+    bool shared = false;
+
+    /*
+     * The hops this message has passed, it is set only for the traced
+     * messages (see msg_trace.h).
+     */
+    std::shared_ptr<TraceHop> trace = nullptr;
+
 private:
     /*
      * Each message has it's unique ID when created. If we clone the message,
      * for example in the BaseSplitter, it's UID is also cloned.
      */
-    unsigned int uid;
+    uint64_t uid;
 };
 
+/*
+ * A message can be delivered to several nodes as the same object (see
+ * BaseSplitter with the shared payload). Such message is immutable: a node
+ * that modifies the input message in place, or forwards it to the other node,
+ * shell call make_writable first. If the message is still referenced elsewhere
+ * it is replaced by a private copy, otherwise nothing is done, so the copy is
+ * made only when it is really needed.
+ */
+template<typename tMsg>
+void make_writable(std::shared_ptr<tMsg>& msg){
+    if(!msg) return;
+    if(msg.use_count() > 1){
+        msg = std::shared_ptr<tMsg>(new tMsg(*msg));
+    }else{
+        // use_count is a relaxed load, the other owners could read the message
+        // just before they released it, their reads shell complete before our writes
+        std::atomic_thread_fence(std::memory_order_acquire);
+        msg->shared = false;
+    }
+}
+
 // custom tData shell have a copy constructor, so there is no sense to use this
 // class with custom data structures, however a lot's of STL classes
 // hav their copy constructors well implemented
@@ -121,6 +232,10 @@ struct GenericDataPkt : public BaseMessage{
         this->val = msg.val;
     };
 
+    virtual size_t payload_size() const {
+        return sizeof(tData);
+    }
+
     // signal data
     tData val;
 };
@@ -134,6 +249,16 @@ struct RealSignalPkt : public BaseMessage{
         this->data = msg.data;
     };
 
+    virtual size_t payload_size() const {
+        return data.size()*sizeof(double);
+    }
+
+    // the vector keeps it's capacity for the next frame
+    virtual void recycle(){
+        BaseMessage::recycle();
+        data.clear();
+    }
+
     // signal data
     std::vector<double> data;
 };
@@ -148,9 +273,67 @@ struct ComplexSignalPkt : public BaseMessage{
         this->data = msg.data;
     }
 
+    virtual size_t payload_size() const {
+        return data.size()*sizeof(double);
+    }
+
+    // the vector keeps it's capacity for the next frame
+    virtual void recycle(){
+        BaseMessage::recycle();
+        data.clear();
+    }
+
     //the C-style complex number array: [ReImReImReIm....]
     //it's size is 2*N
     std::vector<double> data;
 };
 
+/*
+ * The binary layout of the standard packets (see serialization.h). The signal
+ * packets are written as the plain arrays of doubles.
+ */
+template<>
+struct MsgSerializer<RealSignalPkt> :
+        public MsgVectorSerializer<RealSignalPkt, double, std::vector<double>, &RealSignalPkt::data>{
+    static const char* name(){return "RealSignalPkt";}
+};
+
+template<>
+struct MsgSerializer<ComplexSignalPkt> :
+        public MsgVectorSerializer<ComplexSignalPkt, double, std::vector<double>, &ComplexSignalPkt::data>{
+    static const char* name(){return "ComplexSignalPkt";}
+};
+
+/*
+ * Only a trivially copyable tData is serializable, the name includes it's mangled
+ * type name, so the records are compatible between the builds with the same C++ ABI.
+ */
+template<typename tData>
+struct MsgSerializer<GenericDataPkt<tData>, typename std::enable_if<std::is_trivially_copyable<tData>::value>::type>{
+    static const char* name(){
+        static const std::string n = std::string("GenericDataPkt<") + typeid(tData).name() + ">";
+        return n.c_str();
+    }
+
+    static uint16_t version(){return 1;}
+
+    static size_t size(const GenericDataPkt<tData>&){
+        return sizeof(tData);
+    }
+
+    static void write(const GenericDataPkt<tData>& msg, char* dst){
+        memcpy(dst, &msg.val, sizeof(tData));
+    }
+
+    static bool read(const char* src, size_t bytes, uint16_t, GenericDataPkt<tData>& msg){
+        if(bytes != sizeof(tData)) return false;
+        memcpy(&msg.val, src, sizeof(tData));
+        return true;
+    }
+
+    static const void* view(const GenericDataPkt<tData>& msg){
+        return &msg.val;
+    }
+};
+
 #endif //DISTPIPELINEFWK_DATA_PACKET_TYPES_H
\ No newline at end of file
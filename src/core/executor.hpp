@@ -0,0 +1,177 @@
+#ifndef DISTPIPELINEFWK_EXECUTOR_HPP
+#define DISTPIPELINEFWK_EXECUTOR_HPP
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+/*
+ * By default each node lives in it's own thread. With 30+ nodes per graph
+ * there are many more threads than cores, and a lot of time is lost in
+ * the context switches. A node created with EXEC_MODE::POOL (see NodeAttr)
+ * does not occupy a thread, instead it is a task that is scheduled on
+ * a fixed pool of workers each time it's input queue becomes non-empty.
+ *
+ * Each worker has it's own task deque. A task scheduled from a worker
+ * thread (a node that sends a message to the next one) is pushed into
+ * the deque of this worker, so the message is likely to be processed on the
+ * same core while it is still in cache. An idle worker steals the oldest task
+ * from the other deques.
+ */
+
+struct IPoolTask{
+    // process a slice of the pending work, it is never called concurrently
+    // for the same task object
+    virtual void run_slice() = 0;
+    virtual ~IPoolTask(){}
+};
+
+class WorkStealingPool{
+public:
+    /*
+     * The pool is created on the first use and is never destroyed: nodes are
+     * stopped by the NodeFactory destructor at program exit, that can happen
+     * after the destruction of any other static object.
+     */
+    static WorkStealingPool& instance(){
+        static WorkStealingPool* pool = new WorkStealingPool(std::thread::hardware_concurrency());
+        return *pool;
+    }
+
+    void submit(IPoolTask* task){
+        auto id = worker_id();
+        if(id < 0 || id >= (int)workers.size())
+            id = (int)(next_worker++ % workers.size());
+
+        // counted before the push, so a worker never sleeps with a task in the deques
+        pending++;
+        {
+            std::unique_lock<std::mutex> lck(workers[id]->mtx);
+            workers[id]->tasks.push_back(task);
+        }
+
+        // wake one of the idle workers if any
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(n_idle.load(std::memory_order_relaxed) > 0){
+            std::unique_lock<std::mutex> lck(idle_mtx);
+            idle_cv.notify_one();
+        }
+    }
+
+    size_t size() const {return workers.size();}
+
+    // the calling thread is one of the pool workers
+    static bool in_worker(){
+        return worker_id() >= 0;
+    }
+
+    /*
+     * A worker that has to wait for the other task (a full input queue of the next
+     * node with the WAIT policy) shell not just sleep: with the long WAIT chains
+     * all workers would be blocked and the tasks that can free the queues would
+     * never run. Instead it runs the task it is waiting for, if the task is still
+     * in one of the deques. Only this task is run: an unrelated one could wait for
+     * a node that is suspended below on the same stack and never progress.
+     * Returns false if the task is not pending (it is running on the other worker).
+     */
+    bool help(IPoolTask* task){
+        if(worker_id() < 0) return false;
+
+        bool found = false;
+        for(auto& w : workers){
+            std::unique_lock<std::mutex> lck(w->mtx);
+            for(auto it = w->tasks.begin(); it != w->tasks.end(); it++){
+                if(*it == task){
+                    w->tasks.erase(it);
+                    found = true;
+                    break;
+                }
+            }
+            if(found) break;
+        }
+        if(!found) return false;
+
+        pending--;
+        task->run_slice();
+        return true;
+    }
+
+private:
+    struct Worker{
+        std::mutex mtx;
+        std::deque<IPoolTask*> tasks;
+        std::thread thread;
+    };
+
+    WorkStealingPool(unsigned int n){
+        if(n < 2) n = 2;
+        for(unsigned int i = 0; i < n; i++)
+            workers.emplace_back(new Worker);
+        for(unsigned int i = 0; i < n; i++)
+            workers[i]->thread = std::thread(work, this, (int)i);
+    }
+
+    static int& worker_id(){
+        static thread_local int id = -1;
+        return id;
+    }
+
+    // own tasks are taken from the back (the most recent), stolen from the front
+    IPoolTask* take(int id){
+        auto& w = *workers[id];
+        {
+            std::unique_lock<std::mutex> lck(w.mtx);
+            if(!w.tasks.empty()){
+                auto task = w.tasks.back();
+                w.tasks.pop_back();
+                return task;
+            }
+        }
+        for(size_t i = 1; i < workers.size(); i++){
+            auto& v = *workers[(id + i) % workers.size()];
+            std::unique_lock<std::mutex> lck(v.mtx);
+            if(!v.tasks.empty()){
+                auto task = v.tasks.front();
+                v.tasks.pop_front();
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    static void work(WorkStealingPool* pool, int id){
+        worker_id() = id;
+        while(1){
+            auto task = pool->take(id);
+            if(task){
+                pool->pending--;
+                task->run_slice();
+                continue;
+            }
+
+            // nothing to do, sleep until a new task is submitted
+            std::unique_lock<std::mutex> lck(pool->idle_mtx);
+            pool->n_idle++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            pool->idle_cv.wait(lck, [pool]{return pool->pending.load() > 0;});
+            pool->n_idle--;
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned int> next_worker{0};
+
+    // number of submitted and not yet taken tasks
+    std::atomic<long> pending{0};
+
+    std::mutex idle_mtx;
+    std::condition_variable idle_cv;
+    std::atomic<int> n_idle{0};
+};
+
+#endif //DISTPIPELINEFWK_EXECUTOR_HPP
@@ -0,0 +1,34 @@
+#ifndef DISTPIPELINEFWK_FILTER_STAGE_HPP
+#define DISTPIPELINEFWK_FILTER_STAGE_HPP
+
+#include <memory>
+
+#include "base_filter.hpp"
+
+/*
+ * FilterStage<F> is a filter F (derived from BaseFilter) that is used as a plain
+ * function object inside another node, for example in FusedFilter. It is never
+ * started, so it has no thread and it's input queue is never used: operator()
+ * just calls the filter function with the same attached data rules as
+ * BaseFilter::process_usr_msg.
+ *
+ * The filters keep their constructors protected (only NodeFactory creates nodes),
+ * the derived FilterStage has access to them, so the stage is created directly:
+ *
+ * auto s = std::make_shared<FilterStage<PowerFilter<ComplexSignalPkt, RealSignalPkt>>>(MODE::POW_DB);
+ */
+template<typename F>
+class FilterStage final : public F{
+public:
+    using tPtrIn = typename F::tPtrIn;
+    using tPtrOut = typename F::tPtrOut;
+
+    template<typename... Args>
+    FilterStage(Args... as) : F(as...) {}
+
+    tPtrOut operator()(tPtrIn&& msg){
+        return F::apply_filter(std::move(msg));
+    }
+};
+
+#endif //DISTPIPELINEFWK_FILTER_STAGE_HPP
@@ -0,0 +1,128 @@
+#ifndef DISTPIPELINEFWK_FUSED_FILTER_HPP
+#define DISTPIPELINEFWK_FUSED_FILTER_HPP
+
+#include <memory>
+#include <type_traits>
+
+#include "base_filter.hpp"
+#include "filter_stage.hpp"
+
+/*
+ * A linear chain of filters F1 -> F2 -> ... -> Fn that is executed inside a single
+ * node. When the stages are strictly sequential there is no reason to pay for
+ * n-1 queue hops, thread wakeups and intermediate messages in the queues. For
+ * example, in the tutorial 03_leakage:
+ *
+ * using tSpectrum = FusedFilter<DFTFilter<RealSignalPkt, ComplexSignalPkt>,
+ *                               PowerFilter<ComplexSignalPkt, RealSignalPkt>>;
+ * auto spectrum = NodeFactory::create<tSpectrum>();
+ * src->set_target(spectrum);
+ * spectrum->set_target(dev_osc);
+ *
+ * The output message type of each stage shell coincide with the input of the next
+ * one, it is checked at compile time. The chain is unrolled by templates, so
+ * the filter functions are called back to back with no dynamic dispatch between
+ * the stages. The attached data is moved from stage to stage by exactly the same
+ * rules as between the separate filter nodes.
+ *
+ * By default all stages are default-constructed. To configure them create
+ * the stages explicitly and pass them to the constructor:
+ *
+ * auto pow = std::make_shared<FilterStage<tAbsComplex>>(tAbsComplex::POW_DB);
+ * auto dft = std::make_shared<FilterStage<tDFTFilter>>();
+ * auto spectrum = NodeFactory::create<tSpectrum>(QUEUE_POLICY::DROP, "Spectrum", dft, pow);
+ *
+ * The USER command messages are applied to the FusedFilter node and then to each
+ * stage in the chain order, as if the stages were the separate nodes. A stage that
+ * checks the command itself in it's internal_filter (as DFrFTFilter does)
+ * receives it as usual. See the tutorial 12_fused.
+ */
+
+template<typename... Fs>
+struct FusedChain;
+
+template<typename F>
+struct FusedChain<F>{
+    using tPtrIn = typename F::tPtrIn;
+    using tPtrOut = typename F::tPtrOut;
+
+    FusedChain() : stage{new FilterStage<F>()} {}
+    FusedChain(std::shared_ptr<FilterStage<F>> stage) : stage{stage} {}
+
+    tPtrOut operator()(tPtrIn&& msg){
+        return (*stage)(std::move(msg));
+    }
+
+    void apply(const ICloneable::tPtrConstCloneable& cmd){
+        cmd->apply(stage.get());
+    }
+
+    std::shared_ptr<FilterStage<F>> stage;
+};
+
+template<typename F, typename... Rest>
+struct FusedChain<F, Rest...>{
+    using tNext = FusedChain<Rest...>;
+    using tPtrIn = typename F::tPtrIn;
+    using tPtrOut = typename tNext::tPtrOut;
+
+    static_assert(std::is_same<typename F::tPtrOut, typename tNext::tPtrIn>(),
+                  "output message type of the fused stage shell be the input type of the next one");
+
+    FusedChain() : stage{new FilterStage<F>()} {}
+    FusedChain(std::shared_ptr<FilterStage<F>> stage, std::shared_ptr<FilterStage<Rest>>... rest) :
+            stage{stage}, next{rest...} {}
+
+    tPtrOut operator()(tPtrIn&& msg){
+        auto out_msg = (*stage)(std::move(msg));
+
+        // the stage does not want to send anything (it has processed a command, etc.)
+        if(!out_msg) return nullptr;
+        return next(std::move(out_msg));
+    }
+
+    void apply(const ICloneable::tPtrConstCloneable& cmd){
+        cmd->apply(stage.get());
+        next.apply(cmd);
+    }
+
+    std::shared_ptr<FilterStage<F>> stage;
+    tNext next;
+};
+
+template<typename... Fs>
+class FusedFilter : public BaseFilter<typename FusedChain<Fs...>::tPtrIn::element_type,
+                                      typename FusedChain<Fs...>::tPtrOut::element_type>{
+public:
+    using tChain = FusedChain<Fs...>;
+    using tBase = BaseFilter<typename tChain::tPtrIn::element_type,
+                             typename tChain::tPtrOut::element_type>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrOut = typename tBase::tPtrOut;
+
+protected:
+    friend class NodeFactory;
+    FusedFilter(QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "FusedFilter"):
+            tBase(nullptr, pol, name) {}
+
+    FusedFilter(QUEUE_POLICY pol, std::string name, std::shared_ptr<FilterStage<Fs>>... stages):
+            tBase(nullptr, pol, name), chain{stages...} {}
+
+    virtual tPtrOut internal_filter(tPtrIn&& msg){
+        // the node itself has already applied the command, see BaseNode::run
+        if(msg->cmd == MSG_CMD::USER && msg->user_data)
+            chain.apply(msg->user_data);
+
+        auto out_msg = chain(std::move(msg));
+
+        // the attached data was already moved through the stages,
+        // the BaseFilter shell not overwrite it with the input message data
+        if(out_msg) out_msg->keep_prev_attached_data = false;
+        return out_msg;
+    }
+
+private:
+    tChain chain;
+};
+
+#endif //DISTPIPELINEFWK_FUSED_FILTER_HPP
@@ -0,0 +1,134 @@
+#ifndef DISTPIPELINEFWK_MSG_POOL_HPP
+#define DISTPIPELINEFWK_MSG_POOL_HPP
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+#include "data_packet_types.h"
+
+/*
+ * At the steady state a pipeline is sending frames of the same size, but each
+ * stage allocates a new output message with a new data vector, and the message
+ * of the previous stage is freed in the other thread. This is a pure allocator
+ * churn.
+ *
+ * MsgPool<tMsg> keeps the released messages of one type and gives them back
+ * on the next acquire(). The message returns to the pool by the custom deleter
+ * of it's shared_ptr, so a pooled message is used exactly as any other one and
+ * can be sent to any node. A returned message is reset by BaseMessage::recycle(),
+ * the payload vectors are cleared but keep their capacity, so a resize() to the
+ * same frame size does not allocate.
+ *
+ * Usage in a filter:
+ *
+ *     auto out_msg = MsgPool<tOut>::acquire();
+ *     out_msg->data.resize(N);
+ *
+ * Each message type has it's own pool, it is created on the first use.
+ */
+
+struct MsgPoolStats{
+    // acquire() returned a recycled message
+    unsigned long hits;
+    // acquire() had to allocate a new message
+    unsigned long misses;
+    // number of messages that wait in the pool
+    size_t free;
+};
+
+template<typename tMsg>
+class MsgPool{
+    static_assert(std::is_base_of<BaseMessage, tMsg>(),
+                  "tMsg shell be derived from BaseMessage");
+
+    struct State{
+        ~State(){
+            for(auto p : free) delete p;
+        }
+
+        std::mutex mtx;
+        std::vector<tMsg*> free;
+        size_t max_free = 64;
+        std::atomic<unsigned long> hits{0};
+        std::atomic<unsigned long> misses{0};
+    };
+
+    /*
+     * The deleter holds the pool state, so the messages that are still alive
+     * at program exit can be safely released after the static pool is destroyed.
+     */
+    struct Recycler{
+        std::shared_ptr<State> st;
+
+        void operator()(tMsg* p) const {
+            p->recycle();
+            {
+                std::unique_lock<std::mutex> lck(st->mtx);
+                if(st->free.size() < st->max_free){
+                    st->free.push_back(p);
+                    return;
+                }
+            }
+            delete p;
+        }
+    };
+
+public:
+    using tPtrMsg = std::shared_ptr<tMsg>;
+
+    static tPtrMsg acquire(){
+        auto& st = state();
+        tMsg* p = nullptr;
+        {
+            std::unique_lock<std::mutex> lck(st->mtx);
+            if(!st->free.empty()){
+                p = st->free.back();
+                st->free.pop_back();
+            }
+        }
+
+        if(p){
+            // a recycled message takes the UID of this thread, see BaseMessage::recycle
+            p->set_uid(NodeFactory::next_msg_uid());
+            st->hits++;
+        }else{
+            st->misses++;
+            p = new tMsg;
+        }
+
+        return tPtrMsg(p, Recycler{st});
+    }
+
+    /*
+     * The maximal number of messages kept in the pool, the rest are deleted
+     * when released. It shell be above the number of messages of this type
+     * that are in flight at the same time (sum of the input queue limits).
+     */
+    static void set_max_free(size_t n){
+        auto& st = state();
+        std::unique_lock<std::mutex> lck(st->mtx);
+        st->max_free = n;
+        while(st->free.size() > n){
+            delete st->free.back();
+            st->free.pop_back();
+        }
+    }
+
+    static MsgPoolStats stats(){
+        auto& st = state();
+        std::unique_lock<std::mutex> lck(st->mtx);
+        return MsgPoolStats{st->hits.load(), st->misses.load(), st->free.size()};
+    }
+
+private:
+    static std::shared_ptr<State>& state(){
+        static std::shared_ptr<State> st(new State);
+        return st;
+    }
+};
+
+#endif //DISTPIPELINEFWK_MSG_POOL_HPP
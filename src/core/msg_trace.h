@@ -0,0 +1,190 @@
+#ifndef DISTPIPELINEFWK_MSG_TRACE_H
+#define DISTPIPELINEFWK_MSG_TRACE_H
+
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <iomanip>
+
+#include "node_stats.h"
+#include "node_factory.hpp"
+
+/*
+ * End-to-end message latency tracing. A traced message carries a chain of hops,
+ * each hop is a node that has received the message: the time when it was put
+ * into the node input queue (enq_ns) and when the node has taken it from the
+ * queue (deq_ns). The difference is the queueing latency of the hop, the time
+ * from deq_ns to enq_ns of the next hop is the processing latency of the node
+ * (including the put into the next queue).
+ *
+ * The tracing is optional, a message is traced only when it passes through a
+ * node with NodeAttr::trace_start, the node starts a new trace for each message
+ * it receives. BaseSource with trace_start starts the trace when the message
+ * is created. The trace is moved to the next message by init_attached_data,
+ * as all other attached data, so it follows the message through the filters,
+ * splitters and joins (the join keeps the trace of it's first input). A node
+ * with NodeAttr::trace_sink adds the traces it receives into the global
+ * TraceAggregator, that computes the latency percentiles of each path:
+ *
+ * NodeAttr a; a.trace_start = true;
+ * auto src = NodeFactory::create_with<tSource>(a, src_proc);
+ * NodeAttr b; b.trace_sink = true;
+ * auto dev = NodeFactory::create_with<tDevice>(b, dev_proc);
+ * ...
+ * TraceAggregator::global().report(std::cout);
+ *
+ * The hops are never modified after the message leaves the node, so the copies of
+ * a message made by a splitter share the common part of their traces. A loop in
+ * the graph is cut by a trace_start node, otherwise the trace stops growing
+ * after max_hops.
+ */
+struct TraceHop{
+    static constexpr unsigned int max_hops = 64;
+
+    TraceHop(std::shared_ptr<TraceHop> prev, unsigned int node, uint64_t enq_ns):
+            prev{prev}, node{node}, enq_ns{enq_ns}, deq_ns{0},
+            depth{prev ? prev->depth + 1 : 0} {}
+
+    // the previous hop, null for the first one
+    std::shared_ptr<TraceHop> prev;
+
+    // the node that has received the message
+    unsigned int node;
+    uint64_t enq_ns;
+    uint64_t deq_ns;
+
+    // the number of the previous hops
+    unsigned int depth;
+};
+
+/*
+ * Latency statistics of the traced messages grouped by their paths (the sequence
+ * of the node UIDs). It is thread safe, each add takes a mutex, so the tracing
+ * is not meant to be always on.
+ */
+class TraceAggregator{
+public:
+    struct HopReport{
+        unsigned int node;
+        // from enq_ns to deq_ns of the hop
+        HistogramSnapshot queue;
+        // from deq_ns to the enq_ns of the next hop
+        HistogramSnapshot service;
+    };
+
+    struct PathReport{
+        std::vector<unsigned int> nodes;
+        // from the first enq_ns to the end of the trace
+        HistogramSnapshot total;
+        std::vector<HopReport> hops;
+    };
+
+    // the one used by the trace_sink nodes
+    static TraceAggregator& global(){
+        static TraceAggregator* aggr = new TraceAggregator;
+        return *aggr;
+    }
+
+    // account a trace that ends at 'end_ns' (the last hop service time ends there)
+    void add(const std::shared_ptr<TraceHop>& last, uint64_t end_ns){
+        if(!last) return;
+
+        std::vector<const TraceHop*> hops;
+        for(auto h = last.get(); h; h = h->prev.get())
+            hops.push_back(h);
+
+        std::vector<unsigned int> key(hops.size());
+        for(size_t i = 0; i < hops.size(); i++)
+            key[i] = hops[hops.size() - 1 - i]->node;
+
+        std::unique_lock<std::mutex> lck(mtx);
+        auto& path = paths[key];
+        if(!path) path.reset(new PathStats(key.size()));
+
+        auto first = hops.back();
+        path->total.record(end_ns - first->enq_ns);
+        for(size_t i = 0; i < key.size(); i++){
+            auto h = hops[hops.size() - 1 - i];
+            auto deq = h->deq_ns ? h->deq_ns : h->enq_ns;
+            auto next = i + 1 < key.size() ? hops[hops.size() - 2 - i]->enq_ns : end_ns;
+            path->hops[i]->queue.record(deq - h->enq_ns);
+            path->hops[i]->service.record(next > deq ? next - deq : 0);
+        }
+    }
+
+    std::vector<PathReport> snapshot(){
+        std::unique_lock<std::mutex> lck(mtx);
+        std::vector<PathReport> out;
+        for(auto& kv : paths){
+            PathReport r;
+            r.nodes = kv.first;
+            r.total = kv.second->total.snapshot();
+            for(size_t i = 0; i < kv.first.size(); i++){
+                HopReport h;
+                h.node = kv.first[i];
+                h.queue = kv.second->hops[i]->queue.snapshot();
+                h.service = kv.second->hops[i]->service.snapshot();
+                r.hops.push_back(h);
+            }
+            out.push_back(r);
+        }
+        return out;
+    }
+
+    void clear(){
+        std::unique_lock<std::mutex> lck(mtx);
+        paths.clear();
+    }
+
+    // human readable percentiles in microseconds
+    void report(std::ostream& os){
+        auto us = [](uint64_t ns){return ns/1000.0;};
+        auto pcts = [&](const HistogramSnapshot& h){
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(1)
+               << "p50 " << us(h.percentile(0.5)) << " p90 " << us(h.percentile(0.9))
+               << " p99 " << us(h.percentile(0.99)) << " max " << us(h.max);
+            return ss.str();
+        };
+
+        for(auto& p : snapshot()){
+            os << "path:";
+            for(size_t i = 0; i < p.nodes.size(); i++)
+                os << (i ? " -> " : " ") << node_label(p.nodes[i]);
+            os << " (" << p.total.count << " messages)" << std::endl;
+            os << "  total [us]: " << pcts(p.total) << std::endl;
+            for(auto& h : p.hops){
+                os << "  " << node_label(h.node) << " queue [us]: " << pcts(h.queue) << std::endl;
+                os << "  " << node_label(h.node) << " service [us]: " << pcts(h.service) << std::endl;
+            }
+        }
+    }
+
+private:
+    struct HopStats{
+        LatencyHistogram queue;
+        LatencyHistogram service;
+    };
+
+    struct PathStats{
+        PathStats(size_t n){
+            for(size_t i = 0; i < n; i++) hops.emplace_back(new HopStats);
+        }
+        LatencyHistogram total;
+        std::vector<std::unique_ptr<HopStats>> hops;
+    };
+
+    static std::string node_label(unsigned int uid){
+        auto name = NodeFactory::node_name(uid);
+        return name.empty() ? std::to_string(uid) : name;
+    }
+
+    std::mutex mtx;
+    std::map<std::vector<unsigned int>, std::unique_ptr<PathStats>> paths;
+};
+
+#endif //DISTPIPELINEFWK_MSG_TRACE_H
@@ -6,6 +6,13 @@
 #define DISTPIPELINEFWK_NODE_FACTORY_H
 
 #include <map>
+#include <atomic>
+#include <cstdint>
+#include <set>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <chrono>
 #include <random>
 #include <memory>
 #include <cstdarg>
@@ -22,20 +29,70 @@ public:
                       "tNode shell be derived from CommandNode");
 
         auto ptr = std::shared_ptr<tNode>(new tNode(as...));
-        auto& factory = nr();
-
-        unsigned int uid;
-        do{
-            uid = factory.rnd_gen();
-        }while(factory.nodes.find(uid) != factory.nodes.end() && uid > 10);
+        reg_and_start(ptr, nr().default_attr.get());
+        return ptr;
+    }
 
-        std::static_pointer_cast<CommandNode>(ptr)->set_uid(uid);
-        factory.nodes.insert(std::make_pair(uid, ptr));
-        ptr->start();
+    /*
+     * The same as 'create', however the node attributes (input queue type, etc.)
+     * are set before the node is started. See NodeAttr in command_node.h.
+     */
+    template<typename tNode, typename... Args>
+    static std::shared_ptr<tNode> create_with(const NodeAttr& attr, Args... as){
+        static_assert(std::is_base_of<CommandNode, tNode>(),
+                      "tNode shell be derived from CommandNode");
 
+        auto ptr = std::shared_ptr<tNode>(new tNode(as...));
+        reg_and_start(ptr, &attr);
         return ptr;
     }
 
+    /*
+     * Attributes to be used by 'create' for all nodes created afterwards, for example
+     * to switch a whole graph into the EXEC_MODE::POOL without changing each create call.
+     */
+    static void set_default_attr(const NodeAttr& attr){
+        nr().default_attr.reset(new NodeAttr(attr));
+    }
+
+    /*
+     * With the deferred start 'create' only registers the node, the whole graph
+     * is started afterwards by start_all, so no node receives messages before
+     * it's targets are running.
+     */
+    static void set_deferred_start(bool deferred){
+        nr().deferred_start = deferred;
+    }
+
+    /*
+     * Start all registered nodes that are not running. The nodes are started in
+     * the reverse topological order (the sinks first) by levels: the threads of
+     * a level are launched at once and the next level is started when all of
+     * them confirm the start. The graph edges are the set_target/add_target calls.
+     */
+    static void start_all(){
+        for(auto& level : levels(false)){
+            for(auto node : level) node->start_async();
+            for(auto node : level) node->wait_started();
+        }
+    }
+
+    /*
+     * Stop all nodes in the topological order (the sources first), the nodes of
+     * one level are stopped in parallel. With 'drain' each level waits until the
+     * input queues of it's nodes are empty, so the messages sent by the already
+     * stopped upstream are processed, otherwise they are discarded by STOP.
+     */
+    static void stop_all(bool drain = false){
+        for(auto& level : levels(true)){
+            if(drain){
+                for(auto node : level) node->wait_drained();
+            }
+            for(auto node : level) node->stop_async();
+            for(auto node : level) node->wait_stopped();
+        }
+    }
+
     template<typename tNode>
     static std::shared_ptr<tNode> get_node(unsigned int uid){
         auto& factory = nr();
@@ -47,10 +104,31 @@ public:
         return ptr;
     }
 
-    static unsigned int generate_random_uid(){
-        return nr().rnd_gen();
+    /*
+     * A new message UID: (origin << 48) | sequence. Each thread that creates
+     * messages takes an origin once and counts it's own sequence, so the UIDs
+     * are unique and cost no synchronization on the hot path. The sequence of a
+     * thread counts all messages it creates (the commands, the pooled messages),
+     * so it has gaps. BaseSource restamps it's output with it's own origin and a
+     * sequence that counts only the emitted messages, there a gap is a lost
+     * message (see BaseSource::stamp). The origins of a process start at a random
+     * number, so the messages that come from the other processes (see
+     * shm_edge.hpp, remote_edge.hpp) are unlikely to share an origin.
+     */
+    static uint64_t next_msg_uid(){
+        static thread_local uint64_t origin = (uint64_t)next_msg_origin() << msg_seq_bits;
+        static thread_local uint64_t seq = 0;
+        return origin | (++seq & msg_seq_mask);
     }
 
+    // a new origin for a thread or a source node, see next_msg_uid
+    static uint16_t next_msg_origin(){
+        return nr().next_origin.fetch_add(1);
+    }
+
+    static constexpr unsigned msg_seq_bits = 48;
+    static constexpr uint64_t msg_seq_mask = (1ull << msg_seq_bits) - 1;
+
     static std::string node_name(unsigned int uid){
         auto& factory = nr();
         auto it = factory.nodes.find(uid);
@@ -62,17 +140,139 @@ public:
         return std::string();
     }
 
+    /*
+     * Read the metrics of all registered nodes. The counters are read one by one
+     * while the graph is running, so the snapshot is not atomic, but each value
+     * is exact at the moment it was read.
+     */
+    static std::vector<NodeStatsSnapshot> stats_snapshot(){
+        auto& factory = nr();
+        std::vector<NodeStatsSnapshot> out;
+        std::map<unsigned int, uint64_t> sent;
+
+        for(auto& kv : factory.nodes){
+            auto& node = *kv.second;
+            auto& st = node.stats;
+
+            NodeStatsSnapshot s;
+            s.uid = kv.first;
+            s.name = node.name;
+            s.msgs_in = st.msgs_in.load(std::memory_order_relaxed);
+            s.msgs_out = 0;
+            s.processed = st.processed.load(std::memory_order_relaxed);
+            for(size_t i = 0; i < (size_t)DROP_REASON::COUNT; i++)
+                s.drops[i] = st.drops[i].load(std::memory_order_relaxed);
+            s.blocked_ns = st.blocked_ns.load(std::memory_order_relaxed);
+            s.blocked = st.blocked.load(std::memory_order_relaxed);
+            s.queue_depth = node.queue_size();
+            s.high_water = st.high_water.load(std::memory_order_relaxed);
+            s.proc_time = st.proc_time.snapshot();
+
+            for(size_t i = 0; i < EdgeStats::n_slots; i++){
+                auto& slot = st.edges.at(i);
+                auto key = slot.key.load(std::memory_order_acquire);
+                bool other = i == EdgeStats::n_slots - 1;
+                if(!key && !other) continue;
+
+                EdgeSnapshot e;
+                e.from = key ? (unsigned int)(key - 1) : 0;
+                e.other = other;
+                e.msgs = slot.msgs.load(std::memory_order_relaxed);
+                e.drops = slot.drops.load(std::memory_order_relaxed);
+                if(other && !e.msgs && !e.drops) continue;
+
+                if(!other) sent[e.from] += e.msgs;
+                s.edges.push_back(e);
+            }
+            out.push_back(s);
+        }
+
+        for(auto& s : out) s.msgs_out = sent[s.uid];
+        return out;
+    }
+
     ~NodeFactory(){
         // it is more stable to stop all nodes before
         // they are destructed
-        for(auto kv : nodes)
-            kv.second->stop();
+        stop_all();
     }
 
 private:
+    // assign a new UID, register and start the node, if 'attr' is null the
+    // attributes set by the node constructor are kept
+    static void reg_and_start(std::shared_ptr<CommandNode> ptr, const NodeAttr* attr){
+        auto& factory = nr();
+
+        unsigned int uid;
+        do{
+            uid = factory.rnd_gen();
+        }while(factory.nodes.find(uid) != factory.nodes.end() && uid > 10);
+
+        ptr->set_uid(uid);
+        if(attr) ptr->set_attr(*attr);
+        factory.nodes.insert(std::make_pair(uid, ptr));
+        if(!factory.deferred_start) ptr->start();
+    }
+
+    /*
+     * Split the graph into levels: the longest path from a source (from_sources)
+     * or to a sink. The nodes of a level do not send messages to each other. The
+     * nodes on a loop (feedback) and after it can't be ordered, they are appended
+     * as the last level.
+     */
+    static std::vector<std::vector<CommandNode*>> levels(bool from_sources){
+        auto& factory = nr();
+
+        // the edges along the direction of the walk
+        std::map<unsigned int, std::vector<unsigned int>> out;
+        std::map<unsigned int, size_t> n_in;
+        for(auto& kv : factory.nodes) n_in[kv.first] = 0;
+        for(auto& kv : factory.nodes){
+            std::set<unsigned int> ups;
+            for(auto up : kv.second->get_upstream())
+                if(factory.nodes.count(up)) ups.insert(up);
+            for(auto up : ups){
+                if(from_sources){
+                    out[up].push_back(kv.first);
+                    n_in[kv.first]++;
+                }else{
+                    out[kv.first].push_back(up);
+                    n_in[up]++;
+                }
+            }
+        }
+
+        // Kahn's algorithm, the level is the longest path
+        std::map<unsigned int, size_t> level;
+        std::vector<unsigned int> ready;
+        for(auto& kv : n_in)
+            if(kv.second == 0) ready.push_back(kv.first);
+
+        size_t n_levels = 0;
+        while(!ready.empty()){
+            auto uid = ready.back();
+            ready.pop_back();
+            auto lvl = level[uid];
+            n_levels = std::max(n_levels, lvl + 1);
+            for(auto next : out[uid]){
+                level[next] = std::max(level[next], lvl + 1);
+                if(--n_in[next] == 0) ready.push_back(next);
+            }
+        }
+
+        std::vector<std::vector<CommandNode*>> res(n_levels + 1);
+        for(auto& kv : factory.nodes){
+            bool on_loop = n_in[kv.first] > 0;
+            res[on_loop ? n_levels : level[kv.first]].push_back(kv.second.get());
+        }
+        if(res.back().empty()) res.pop_back();
+        return res;
+    }
+
     // direct construction is forbidden, this is a singleton
     NodeFactory(){
         rnd_gen.seed(time(nullptr));
+        next_origin = (uint16_t)rnd_gen();
     }
 
     // no one can access an object of this singleton except of
@@ -87,9 +287,18 @@ private:
     // random UIDs will protect against UID deduction tricks
     std::default_random_engine rnd_gen;
 
+    // the origin of the next thread that creates a message, see next_msg_uid
+    std::atomic<uint16_t> next_origin{0};
+
     // it is possible to get node by it's UID,
     // also nodes will be alive until the end of the program
     std::map<unsigned int, std::shared_ptr<CommandNode> > nodes;
+
+    // if set, is used by 'create' instead of the attributes set by the node constructor
+    std::unique_ptr<NodeAttr> default_attr;
+
+    // 'create' does not start the nodes, see start_all
+    bool deferred_start = false;
 };
 
 #endif //DISTPIPELINEFWK_NODE_FACTORY_H
@@ -0,0 +1,245 @@
+#ifndef DISTPIPELINEFWK_NODE_STATS_H
+#define DISTPIPELINEFWK_NODE_STATS_H
+
+#include <atomic>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Runtime metrics of the nodes. They are always on, so each counter is a relaxed
+ * atomic that is written by the thread that already owns the corresponding
+ * operation (the producer in put, the node thread in the main loop), there are
+ * no locks and no allocations on the hot path.
+ *
+ * Use NodeFactory::stats_snapshot() to read the metrics of all registered nodes.
+ */
+
+// why a message was lost, see NodeStats::drops
+enum class DROP_REASON{
+    // QUEUE_POLICY::DROP (or DROP_STALE) and the input queue of the node was full
+    QUEUE_FULL,
+    // the node was not running (not started yet or already stopped)
+    NOT_RUNNING,
+    // the message was in the input queue when STOP was processed
+    STOPPED,
+    // BaseSyncJoin evicted an incomplete message (see BaseSyncJoin::JoinPolicy)
+    EVICTED,
+    // a queued message was discarded for a new one by QUEUE_POLICY::DROP_OLDEST
+    EVICTED_OLDEST,
+    // the mailbox message was overwritten (QUEUE_POLICY::COALESCE_LATEST)
+    COALESCED,
+    // the message has waited longer than NodeAttr::max_age (QUEUE_POLICY::DROP_STALE)
+    STALE,
+    // the number of reasons, not a reason
+    COUNT
+};
+
+inline const char* drop_reason_name(DROP_REASON r){
+    switch(r){
+        case DROP_REASON::QUEUE_FULL: return "queue_full";
+        case DROP_REASON::NOT_RUNNING: return "not_running";
+        case DROP_REASON::STOPPED: return "stopped";
+        case DROP_REASON::EVICTED: return "evicted";
+        case DROP_REASON::EVICTED_OLDEST: return "evicted_oldest";
+        case DROP_REASON::COALESCED: return "coalesced";
+        case DROP_REASON::STALE: return "stale";
+        case DROP_REASON::COUNT: break;
+    }
+    return "";
+}
+
+inline uint64_t stats_now_ns(){
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * A copy of the histogram counters, percentiles are computed here.
+ */
+struct HistogramSnapshot{
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    double mean() const {
+        return count ? (double)sum/count : 0.0;
+    }
+
+    // 'q' is in [0,1], the result is the lower bound of the bucket (within 1/8)
+    uint64_t percentile(double q) const;
+};
+
+/*
+ * HDR-style histogram of nanosecond durations. The values below 16 have their
+ * own buckets, above that each power of two is split into 8 linear sub-buckets,
+ * so the relative error is below 1/8 for any value up to 2^64 with only 496
+ * buckets and recording is a couple of bit operations and one atomic add.
+ */
+class LatencyHistogram{
+public:
+    static constexpr int sub_bits = 4;
+    static constexpr size_t n_buckets = (1 << sub_bits) + (64 - sub_bits)*(1 << (sub_bits - 1));
+
+    static size_t bucket(uint64_t v){
+        if(v < (1u << sub_bits)) return (size_t)v;
+        int msb = 63 - __builtin_clzll(v);
+        uint64_t top = v >> (msb - sub_bits + 1);
+        return (1 << sub_bits) + (msb - sub_bits)*(1 << (sub_bits - 1)) + (size_t)(top - (1 << (sub_bits - 1)));
+    }
+
+    static uint64_t bucket_low(size_t idx){
+        if(idx < (1u << sub_bits)) return idx;
+        size_t k = idx - (1 << sub_bits);
+        int msb = (int)(k >> (sub_bits - 1)) + sub_bits;
+        uint64_t top = (k & ((1 << (sub_bits - 1)) - 1)) + (1 << (sub_bits - 1));
+        return top << (msb - sub_bits + 1);
+    }
+
+    void record(uint64_t ns){
+        counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        n.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(ns, std::memory_order_relaxed);
+        auto m = vmax.load(std::memory_order_relaxed);
+        while(ns > m && !vmax.compare_exchange_weak(m, ns, std::memory_order_relaxed));
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        s.buckets.resize(n_buckets);
+        for(size_t i = 0; i < n_buckets; i++)
+            s.buckets[i] = counts[i].load(std::memory_order_relaxed);
+        s.count = n.load(std::memory_order_relaxed);
+        s.sum = total.load(std::memory_order_relaxed);
+        s.max = vmax.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::atomic<uint64_t> counts[n_buckets] = {};
+    std::atomic<uint64_t> n{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> vmax{0};
+};
+
+inline uint64_t HistogramSnapshot::percentile(double q) const {
+    uint64_t total = 0;
+    for(auto c : buckets) total += c;
+    if(total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(q*(total - 1)) + 1;
+    uint64_t acc = 0;
+    for(size_t i = 0; i < buckets.size(); i++){
+        acc += buckets[i];
+        if(acc >= rank) return LatencyHistogram::bucket_low(i);
+    }
+    return max;
+}
+
+/*
+ * Messages received by a node from each of it's upstream nodes. The table has
+ * a fixed number of slots, each slot is claimed once by the first message from
+ * a new sender, the senders that do not fit are accounted in the last slot.
+ */
+class EdgeStats{
+public:
+    static constexpr size_t n_slots = 16;
+
+    struct Slot{
+        // sender UID + 1, zero is a free slot (the UID 0 is the main thread)
+        std::atomic<uint64_t> key{0};
+        std::atomic<uint64_t> msgs{0};
+        std::atomic<uint64_t> drops{0};
+    };
+
+    Slot& slot(unsigned int from){
+        uint64_t key = (uint64_t)from + 1;
+        for(size_t i = 0; i < n_slots - 1; i++){
+            auto k = slots[i].key.load(std::memory_order_acquire);
+            if(k == key) return slots[i];
+            if(k == 0){
+                uint64_t expected = 0;
+                if(slots[i].key.compare_exchange_strong(expected, key, std::memory_order_acq_rel) || expected == key)
+                    return slots[i];
+            }
+        }
+        return slots[n_slots - 1];
+    }
+
+    const Slot& at(size_t i) const {return slots[i];}
+
+private:
+    Slot slots[n_slots];
+};
+
+struct EdgeSnapshot{
+    // UID of the upstream node, 0 is the main thread (or any thread outside the graph),
+    // 'other' is set for the senders that did not fit into the table
+    unsigned int from;
+    bool other;
+    uint64_t msgs;
+    uint64_t drops;
+};
+
+struct NodeStats{
+    // messages accepted by the input queue
+    std::atomic<uint64_t> msgs_in{0};
+
+    // messages passed to process_usr_msg
+    std::atomic<uint64_t> processed{0};
+
+    // lost messages by reason
+    std::atomic<uint64_t> drops[(size_t)DROP_REASON::COUNT] = {};
+
+    // time spent by the WAIT producers blocked on the full input queue of this node
+    std::atomic<uint64_t> blocked_ns{0};
+    std::atomic<uint64_t> blocked{0};
+
+    // the maximal input queue depth observed
+    std::atomic<uint64_t> high_water{0};
+
+    // process_usr_msg duration
+    LatencyHistogram proc_time;
+
+    // per upstream node counters
+    EdgeStats edges;
+
+    void drop(DROP_REASON r, uint64_t n = 1){
+        drops[(size_t)r].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void depth(uint64_t d){
+        auto m = high_water.load(std::memory_order_relaxed);
+        while(d > m && !high_water.compare_exchange_weak(m, d, std::memory_order_relaxed));
+    }
+
+    void block(uint64_t ns){
+        blocked_ns.fetch_add(ns, std::memory_order_relaxed);
+        blocked.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct NodeStatsSnapshot{
+    unsigned int uid;
+    std::string name;
+
+    uint64_t msgs_in;
+    // the sum of the messages received by the other nodes from this one
+    uint64_t msgs_out;
+    uint64_t processed;
+    uint64_t drops[(size_t)DROP_REASON::COUNT];
+
+    uint64_t blocked_ns;
+    uint64_t blocked;
+
+    size_t queue_depth;
+    uint64_t high_water;
+
+    HistogramSnapshot proc_time;
+    std::vector<EdgeSnapshot> edges;
+};
+
+#endif //DISTPIPELINEFWK_NODE_STATS_H
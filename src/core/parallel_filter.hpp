@@ -0,0 +1,252 @@
+#ifndef DISTPIPELINEFWK_PARALLEL_FILTER_HPP
+#define DISTPIPELINEFWK_PARALLEL_FILTER_HPP
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <chrono>
+
+#include "base_filter.hpp"
+#include "filter_stage.hpp"
+
+/*
+ * A filter node that runs K replicas of the filter F in parallel. When one stage
+ * is slower than the source (DFrFTFilter takes about 4ms per 1024 point frame)
+ * the frames have to be dropped or the whole pipeline is stalled, with the
+ * replicas the stage throughput scales with the number of cores.
+ *
+ * Each replica is a FilterStage<F> (see filter_stage.hpp) with it's own worker
+ * thread and it's own filter state, so the DFT/DFrFT workspaces are never shared.
+ * The node thread numbers the incoming frames and puts them into a common job
+ * queue, the replica that takes a job sends the result into the reorder buffer.
+ * The results are forwarded to the next node strictly in the input order, so
+ * for the downstream ParallelFilter<F> is the same as F.
+ *
+ * At most 2*K frames can be in flight (taken from the input queue and not yet
+ * forwarded). When it is reached, the node stops pulling the input queue and the
+ * usual queue policy is applied to the upstream.
+ *
+ * using tDFrFT = DFrFTFilter<RealSignalPkt, ComplexSignalPkt>;
+ * auto frft = NodeFactory::create<ParallelFilter<tDFrFT>>(4);
+ *
+ * K can be changed at runtime by set_replicas(k) or by sending the tUsrCmdReplicas
+ * command. The other USER commands are applied to all replicas, after all frames
+ * received before the command are processed. To configure the replicas pass a
+ * function that creates a stage, it is called once per replica.
+ */
+template<typename F>
+class ParallelFilter : public BaseFilter<typename F::tPtrIn::element_type,
+                                         typename F::tPtrOut::element_type>{
+public:
+    using tStage = FilterStage<F>;
+    using tBase = BaseFilter<typename F::tPtrIn::element_type,
+                             typename F::tPtrOut::element_type>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrOut = typename tBase::tPtrOut;
+    using tStageFactory = std::function<std::shared_ptr<tStage>()>;
+
+    // COMMAND MESSAGES
+
+    /*
+     * Change the number of the replicas on the fly.
+     */
+    struct tUsrCmdReplicas : public ICloneable{
+        tUsrCmdReplicas(size_t k) : k{k} {};
+
+        virtual tPtrCloneable clone() const {
+            return std::shared_ptr<tUsrCmdReplicas>(new tUsrCmdReplicas(k));
+        }
+
+        virtual void apply(CommandNode* ptr) const {
+            auto filter = dynamic_cast<ParallelFilter<F>*>(ptr);
+            if(filter) filter->set_replicas(k);
+        }
+
+        size_t k;
+    };
+
+protected:
+    friend class NodeFactory;
+    ParallelFilter(size_t k = std::thread::hardware_concurrency(),
+                   QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "ParallelFilter",
+                   tStageFactory make_stage = nullptr):
+            tBase(nullptr, pol, name),
+            make_stage{make_stage} {
+        if(!this->make_stage)
+            this->make_stage = []{return std::make_shared<tStage>();};
+        set_replicas(k);
+    }
+
+public:
+    ~ParallelFilter(){
+        // the node thread shell not dispatch anything to the workers that are being stopped
+        this->stop();
+
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            quit = true;
+        }
+        job_cv.notify_all();
+
+        std::unique_lock<std::mutex> ctl(ctl_mtx);
+        for(auto& r : replicas)
+            if(r->th.joinable()) r->th.join();
+    }
+
+    /*
+     * Set the number of replicas (at least one). New replicas are created by the
+     * stage factory, the removed ones finish their current frame and are destroyed.
+     */
+    void set_replicas(size_t k){
+        if(k == 0) k = 1;
+
+        std::unique_lock<std::mutex> ctl(ctl_mtx);
+        size_t old;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            old = n_active;
+            n_active = k;
+        }
+        job_cv.notify_all();
+        done_cv.notify_all();
+
+        for(size_t i = k; i < old; i++)
+            replicas[i]->th.join();
+        if(replicas.size() > k) replicas.resize(k);
+
+        for(size_t i = old; i < k; i++){
+            replicas.emplace_back(new Replica);
+            replicas.back()->stage = make_stage();
+            replicas.back()->th = std::thread(work, this, replicas.back().get(), i);
+        }
+    }
+
+    size_t get_replicas(){
+        std::unique_lock<std::mutex> lck(mtx);
+        return n_active;
+    }
+
+protected:
+    virtual bool process_usr_msg(tPtrIn&& msg){
+        if(!this->next){
+            std::cerr << tBase::name << " warning: broken pipe detected" << std::endl;
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lck(mtx);
+
+        // a command is a barrier: it is applied to the replicas when they are idle
+        if(msg->cmd == MSG_CMD::USER && msg->user_data){
+            wait_done(lck, [this]{return n_emitted == n_sent;});
+            lck.unlock();
+            apply_to_replicas(msg->user_data);
+            lck.lock();
+        }
+
+        wait_done(lck, [this]{return n_sent - n_emitted < 2*n_active;});
+        jobs.emplace_back(n_sent++, std::move(msg));
+        job_cv.notify_one();
+        return true;
+    }
+
+private:
+    struct Replica{
+        std::shared_ptr<tStage> stage;
+        std::thread th;
+    };
+
+    /*
+     * Wait for the replicas to forward the results. In POOL mode the caller is a
+     * pool worker, it shell not block: the replicas may wait for the next node
+     * whose task needs a worker, so it runs that task or waits in short slices.
+     */
+    template<typename P>
+    void wait_done(std::unique_lock<std::mutex>& lck, P pred){
+        if(!WorkStealingPool::in_worker()){
+            done_cv.wait(lck, pred);
+            return;
+        }
+        while(!pred()){
+            lck.unlock();
+            bool helped = this->next && this->next->help_drain();
+            lck.lock();
+            if(!helped) done_cv.wait_for(lck, std::chrono::milliseconds(1), pred);
+        }
+    }
+
+    void apply_to_replicas(const ICloneable::tPtrConstCloneable& cmd){
+        std::unique_lock<std::mutex> ctl(ctl_mtx);
+        for(auto& r : replicas)
+            cmd->apply(r->stage.get());
+    }
+
+    static void work(ParallelFilter* f, Replica* r, size_t idx){
+        std::unique_lock<std::mutex> lck(f->mtx);
+        while(1){
+            f->job_cv.wait(lck, [f, idx]{return f->quit || idx >= f->n_active || !f->jobs.empty();});
+            if(f->quit || idx >= f->n_active) return;
+
+            auto job = std::move(f->jobs.front());
+            f->jobs.pop_front();
+
+            lck.unlock();
+            auto out_msg = (*r->stage)(std::move(job.second));
+            lck.lock();
+
+            // a null result still occupies it's place in the sequence
+            f->ready.emplace(job.first, std::move(out_msg));
+
+            // only one worker forwards the results, the others just leave them
+            if(f->emitting) continue;
+            f->emitting = true;
+            f->emit(lck);
+            f->emitting = false;
+        }
+    }
+
+    // forward all consecutive results that are ready, it is called with mtx locked
+    void emit(std::unique_lock<std::mutex>& lck){
+        while(1){
+            auto it = ready.find(n_emitted);
+            if(it == ready.end()) break;
+
+            auto out_msg = std::move(it->second);
+            ready.erase(it);
+            n_emitted++;
+
+            lck.unlock();
+            if(out_msg && !this->next->put(std::move(out_msg), this->uid, this->pol))
+                std::cerr << tBase::name << " warning: failed to forward a message" << std::endl;
+            lck.lock();
+
+            done_cv.notify_all();
+        }
+    }
+
+private:
+    tStageFactory make_stage;
+
+    // the replicas are added and removed under ctl_mtx
+    std::mutex ctl_mtx;
+    std::vector<std::unique_ptr<Replica>> replicas;
+
+    // the job queue and the reorder buffer
+    std::mutex mtx;
+    std::condition_variable job_cv;
+    std::condition_variable done_cv;
+    std::deque<std::pair<uint64_t, tPtrIn>> jobs;
+    std::map<uint64_t, tPtrOut> ready;
+    uint64_t n_sent = 0;
+    uint64_t n_emitted = 0;
+    size_t n_active = 0;
+    bool emitting = false;
+    bool quit = false;
+};
+
+#endif //DISTPIPELINEFWK_PARALLEL_FILTER_HPP
@@ -0,0 +1,209 @@
+#ifndef DISTPIPELINEFWK_RING_QUEUE_HPP
+#define DISTPIPELINEFWK_RING_QUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Bounded lock-free ring buffers used as an alternative to the std::list
+ * input queue of BaseNode (see QUEUE_TYPE in command_node.h).
+ *
+ * Both rings store the elements in a preallocated array, so there is no heap
+ * allocation per message and no mutex on the hot path. The capacity is always
+ * rounded up to the nearest power of two, so the index arithmetic reduces to
+ * a bit mask.
+ *
+ * The rings are non-blocking: try_push returns false when the ring is full and
+ * try_pop returns false when it is empty. Waiting (WAIT policy, empty input
+ * queue) is implemented on top of them in BaseNode.
+ */
+
+namespace ring_detail{
+    // the size of a cache line, used to pad producer and consumer indices
+    // apart, so that they never share a line (false sharing)
+    constexpr size_t cache_line = 64;
+
+    inline size_t round_up_pow2(size_t n){
+        size_t cap = 1;
+        while(cap < n) cap <<= 1;
+        return cap;
+    }
+
+    // a hint for the core that the thread is spinning on a shared variable
+    inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield");
+#endif
+    }
+}
+
+/*
+ * Single producer - single consumer ring (Lamport queue). Only one thread
+ * may call try_push and only one (the other) thread may call try_pop.
+ * Both operations are wait-free.
+ */
+template<typename T>
+class SPSCRing{
+public:
+    SPSCRing(size_t capacity):
+            cap{ring_detail::round_up_pow2(capacity < 2 ? 2 : capacity)},
+            mask{cap - 1},
+            buf{new T[cap]} {}
+
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    // the value is moved out only on success
+    bool try_push(T& val){
+        auto t = tail.load(std::memory_order_relaxed);
+        if(t - head_cache == cap){
+            head_cache = head.load(std::memory_order_acquire);
+            if(t - head_cache == cap) return false;
+        }
+        buf[t & mask] = std::move(val);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& val){
+        auto h = head.load(std::memory_order_relaxed);
+        if(h == tail_cache){
+            tail_cache = tail.load(std::memory_order_acquire);
+            if(h == tail_cache) return false;
+        }
+        val = std::move(buf[h & mask]);
+        // release the slot content immediately, the ring shell not keep messages alive
+        buf[h & mask] = T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called concurrently with push/pop
+    size_t size() const {
+        auto h = head.load(std::memory_order_acquire);
+        auto t = tail.load(std::memory_order_acquire);
+        return t - h;
+    }
+
+    size_t capacity() const {return cap;}
+
+private:
+    const size_t cap;
+    const size_t mask;
+    std::unique_ptr<T[]> buf;
+
+    char pad0[ring_detail::cache_line];
+    // written by the consumer only
+    std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+
+    char pad1[ring_detail::cache_line];
+    // written by the producer only
+    std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+
+    char pad2[ring_detail::cache_line];
+};
+
+/*
+ * Multi producer ring based on the bounded queue of D. Vyukov. Each cell
+ * carries a sequence number that tells whether it is free for the producer
+ * of the current lap or ready for the consumer. Producers reserve cells with
+ * a CAS on the enqueue position, so any number of threads may push.
+ *
+ * The algorithm is symmetric, so try_pop is safe to be called by more than
+ * one thread as well. BaseNode uses it with a single consumer.
+ */
+template<typename T>
+class MPSCRing{
+    struct Cell{
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+public:
+    MPSCRing(size_t capacity):
+            cap{ring_detail::round_up_pow2(capacity < 2 ? 2 : capacity)},
+            mask{cap - 1},
+            cells{new Cell[cap]} {
+        for(size_t i = 0; i < cap; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MPSCRing(const MPSCRing&) = delete;
+    MPSCRing& operator=(const MPSCRing&) = delete;
+
+    // the value is moved out only on success
+    bool try_push(T& val){
+        Cell* cell;
+        auto pos = enq_pos.load(std::memory_order_relaxed);
+        while(1){
+            cell = &cells[pos & mask];
+            auto seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0){
+                if(enq_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }else if(diff < 0){
+                // the cell of the previous lap was not consumed yet, ring is full
+                return false;
+            }else{
+                pos = enq_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(val);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& val){
+        Cell* cell;
+        auto pos = deq_pos.load(std::memory_order_relaxed);
+        while(1){
+            cell = &cells[pos & mask];
+            auto seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0){
+                if(deq_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }else if(diff < 0){
+                // the producer of this cell did not finish yet, ring is empty
+                return false;
+            }else{
+                pos = deq_pos.load(std::memory_order_relaxed);
+            }
+        }
+        val = std::move(cell->data);
+        cell->data = T();
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called concurrently with push/pop
+    size_t size() const {
+        auto d = deq_pos.load(std::memory_order_acquire);
+        auto e = enq_pos.load(std::memory_order_acquire);
+        return e > d ? e - d : 0;
+    }
+
+    size_t capacity() const {return cap;}
+
+private:
+    const size_t cap;
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    char pad0[ring_detail::cache_line];
+    std::atomic<size_t> enq_pos{0};
+
+    char pad1[ring_detail::cache_line];
+    std::atomic<size_t> deq_pos{0};
+
+    char pad2[ring_detail::cache_line];
+};
+
+#endif //DISTPIPELINEFWK_RING_QUEUE_HPP
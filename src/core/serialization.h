@@ -0,0 +1,405 @@
+#ifndef DISTPIPELINEFWK_SERIALIZATION_H
+#define DISTPIPELINEFWK_SERIALIZATION_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <typeindex>
+#include <functional>
+
+#include "cmd_data_types.h"
+
+/*
+ * The binary representation of the messages, used by the edges between processes
+ * (shm_edge.hpp, remote_edge.hpp) and by the stream recorder. A message is a record:
+ *
+ * [MsgRecord header, 40 bytes][body][padding][command data][padding]
+ *
+ * The body and the command data start at 8 byte boundaries, so a record that was
+ * mapped from a file or a shared memory segment can be read in place:
+ *
+ * MsgRecordView rec(ptr, bytes);
+ * if(rec.valid() && rec.is<RealSignalPkt>()) use(rec.body_as<double>(), rec.body_bytes()/sizeof(double));
+ *
+ * The header keeps the message UID and the command, the type of the body (a hash
+ * of the type name) and two versions. The record format version shell match
+ * exactly, the records of the other format are rejected by valid(). The body layout
+ * version of the type is passed to MsgSerializer<T>::read, so a reader can still
+ * decode the bodies written by an older code. The numbers are in the host byte order.
+ *
+ * A message type is serializable when MsgSerializer<T> is specialized, the standard
+ * packets have their specializations next to their definitions. A specialization
+ * provides
+ *
+ * static const char* name() - a stable type name, it's hash is the type id,
+ * static uint16_t version() - the body layout version,
+ * static size_t size(const T& msg) - the body bytes,
+ * static void write(const T& msg, char* dst) - the body,
+ * static bool read(const char* src, size_t bytes, uint16_t version, T& msg),
+ * static const void* view(const T& msg) - the body if it is contiguous in memory
+ * exactly as it is written (it is sent without a copy), or null.
+ *
+ * The attached command data (user_data) is written only if it's type is registered
+ * in CmdDataRegistry. The other attached data (trace) is not serialized.
+ */
+
+struct BaseMessage;
+
+template<typename T, typename Enable = void>
+struct MsgSerializer;
+
+struct MsgRecord{
+    static constexpr uint32_t magic = 0x4D465044; // "DPFM"
+    static constexpr uint16_t format_version = 2;
+    static constexpr size_t align = 8;
+
+    uint32_t tag;
+    uint16_t format;
+    uint16_t type_version;
+    uint32_t type_id;
+    uint32_t cmd;
+    uint64_t uid;
+    uint32_t cmd_bytes;
+    uint32_t reserved;
+    uint64_t body_bytes;
+
+    static size_t pad(size_t bytes){
+        return (bytes + align - 1) & ~(align - 1);
+    }
+
+    // the whole record with the padding
+    size_t record_bytes() const {
+        return sizeof(MsgRecord) + pad((size_t)body_bytes) + pad(cmd_bytes);
+    }
+};
+
+static_assert(sizeof(MsgRecord) == 40, "MsgRecord is a part of the binary format");
+
+// FNV-1a hash of the type name
+inline uint32_t msg_type_id(const char* name){
+    uint32_t h = 2166136261u;
+    for(; *name; name++){
+        h ^= (uint8_t)*name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+ * Serialization of the command data (user_data). A command type TCmd is registered
+ * once, with the same id in all processes:
+ *
+ * CmdDataRegistry::reg<tUsrCmdGain>("gain");
+ *
+ * and shell provide
+ *
+ * void write(std::vector<char>& out) const - append the encoded command,
+ * static std::shared_ptr<TCmd> read(const char* data, size_t bytes) - null on error.
+ */
+class CmdDataRegistry{
+public:
+    template<typename TCmd>
+    static void reg(const std::string& id){
+        auto& r = instance();
+        std::unique_lock<std::mutex> lck(r.mtx);
+        r.writers[std::type_index(typeid(TCmd))] = std::make_pair(id, [](const ICloneable& cmd, std::vector<char>& out){
+            static_cast<const TCmd&>(cmd).write(out);
+        });
+        r.readers[id] = [](const char* data, size_t bytes) -> std::shared_ptr<ICloneable> {
+            return TCmd::read(data, bytes);
+        };
+    }
+
+    // append [id length (uint16)][id][data], false if the type is not registered
+    static bool encode(const ICloneable& cmd, std::vector<char>& out){
+        auto& r = instance();
+        std::unique_lock<std::mutex> lck(r.mtx);
+        auto it = r.writers.find(std::type_index(typeid(cmd)));
+        if(it == r.writers.end()) return false;
+
+        auto& id = it->second.first;
+        uint16_t len = (uint16_t)id.size();
+        out.insert(out.end(), (const char*)&len, (const char*)&len + sizeof(len));
+        out.insert(out.end(), id.begin(), id.end());
+        it->second.second(cmd, out);
+        return true;
+    }
+
+    static std::shared_ptr<ICloneable> decode(const char* data, size_t bytes){
+        uint16_t len;
+        if(bytes < sizeof(len)) return nullptr;
+        memcpy(&len, data, sizeof(len));
+        if(bytes < sizeof(len) + len) return nullptr;
+        std::string id(data + sizeof(len), len);
+
+        auto& r = instance();
+        tReader reader;
+        {
+            std::unique_lock<std::mutex> lck(r.mtx);
+            auto it = r.readers.find(id);
+            if(it == r.readers.end()) return nullptr;
+            reader = it->second;
+        }
+        return reader(data + sizeof(len) + len, bytes - sizeof(len) - len);
+    }
+
+private:
+    using tWriter = std::function<void(const ICloneable&, std::vector<char>&)>;
+    using tReader = std::function<std::shared_ptr<ICloneable>(const char*, size_t)>;
+
+    static CmdDataRegistry& instance(){
+        static CmdDataRegistry* r = new CmdDataRegistry;
+        return *r;
+    }
+
+    std::mutex mtx;
+    std::map<std::type_index, std::pair<std::string, tWriter>> writers;
+    std::map<std::string, tReader> readers;
+};
+
+/*
+ * A record in a buffer, nothing is copied. 'bytes' is the size of the buffer
+ * from 'ptr' to it's end, the record is valid if it fits there.
+ */
+class MsgRecordView{
+public:
+    MsgRecordView(const void* ptr, size_t bytes): ptr{static_cast<const char*>(ptr)}, bytes{bytes} {}
+
+    bool valid() const {
+        if(!ptr || bytes < sizeof(MsgRecord)) return false;
+        auto& h = header();
+        return h.tag == MsgRecord::magic && h.format == MsgRecord::format_version &&
+               h.body_bytes <= bytes && h.record_bytes() <= bytes;
+    }
+
+    const MsgRecord& header() const {return *reinterpret_cast<const MsgRecord*>(ptr);}
+
+    template<typename T>
+    bool is() const {return header().type_id == msg_type_id(MsgSerializer<T>::name());}
+
+    const char* body() const {return ptr + sizeof(MsgRecord);}
+    size_t body_bytes() const {return (size_t)header().body_bytes;}
+
+    // the body as an array of U, it is aligned to 8 bytes if the record is
+    template<typename U>
+    const U* body_as() const {return reinterpret_cast<const U*>(body());}
+
+    const char* cmd_data() const {return body() + MsgRecord::pad(body_bytes());}
+    size_t cmd_bytes() const {return header().cmd_bytes;}
+
+    // the record size, the next one starts there
+    size_t size() const {return header().record_bytes();}
+
+private:
+    const char* ptr;
+    size_t bytes;
+};
+
+/*
+ * A record as a list of the memory parts (a gather list): the header, the body
+ * that is not copied if the serializer has a view, the command data and the
+ * padding. It is reused between the messages to avoid the allocations.
+ */
+struct MsgGather{
+    struct Part{
+        const void* data;
+        size_t bytes;
+    };
+
+    MsgRecord header;
+    std::vector<char> scratch;
+    std::vector<Part> parts;
+    size_t bytes = 0;
+};
+
+namespace msg_serialization_detail{
+    static const char zeros[MsgRecord::align] = {};
+
+    inline void add_part(MsgGather& g, const void* data, size_t bytes){
+        if(!bytes) return;
+        g.parts.push_back(MsgGather::Part{data, bytes});
+        g.bytes += bytes;
+        size_t pad = MsgRecord::pad(bytes) - bytes;
+        if(pad){
+            g.parts.push_back(MsgGather::Part{zeros, pad});
+            g.bytes += pad;
+        }
+    }
+}
+
+/*
+ * Prepare the gather list of 'msg', the message shell not change until the parts
+ * are written. Returns false if the command data can't be serialized.
+ */
+template<typename T>
+bool gather_record(T& msg, MsgGather& g){
+    using tSer = MsgSerializer<T>;
+    using namespace msg_serialization_detail;
+
+    g.scratch.clear();
+    g.parts.clear();
+    g.bytes = 0;
+
+    size_t body = tSer::size(msg);
+    const void* view = tSer::view(msg);
+    if(!view && body){
+        g.scratch.resize(body);
+        tSer::write(msg, g.scratch.data());
+    }
+
+    if(msg.cmd == MSG_CMD::USER && msg.user_data &&
+       !CmdDataRegistry::encode(*msg.user_data, g.scratch))
+        return false;
+    size_t cmd_bytes = g.scratch.size() - (view ? 0 : body);
+
+    auto& h = g.header;
+    h.tag = MsgRecord::magic;
+    h.format = MsgRecord::format_version;
+    h.type_version = tSer::version();
+    h.type_id = msg_type_id(tSer::name());
+    h.uid = msg.get_uid();
+    h.cmd = (uint32_t)msg.cmd;
+    h.cmd_bytes = (uint32_t)cmd_bytes;
+    h.reserved = 0;
+    h.body_bytes = body;
+
+    add_part(g, &h, sizeof(h));
+    add_part(g, view ? view : g.scratch.data(), body);
+    add_part(g, g.scratch.data() + (view ? 0 : body), cmd_bytes);
+    return true;
+}
+
+// copy the gather list into 'dst', it shell have g.bytes
+inline void flatten_record(const MsgGather& g, char* dst){
+    for(auto& p : g.parts){
+        memcpy(dst, p.data, p.bytes);
+        dst += p.bytes;
+    }
+}
+
+// append the record of 'msg' to 'out', returns the record size or zero on error
+template<typename T>
+size_t serialize(T& msg, std::vector<char>& out){
+    MsgGather g;
+    if(!gather_record(msg, g)) return 0;
+    size_t pos = out.size();
+    out.resize(pos + g.bytes);
+    flatten_record(g, out.data() + pos);
+    return g.bytes;
+}
+
+/*
+ * Restore 'msg' from a valid record: the body, the UID, the command and the command
+ * data. Returns false if the record is of the other type or can't be decoded.
+ */
+template<typename T>
+bool deserialize(const MsgRecordView& rec, T& msg){
+    using tSer = MsgSerializer<T>;
+    auto& h = rec.header();
+    if(!rec.is<T>() || h.cmd > (uint32_t)MSG_CMD::USER) return false;
+    if(!tSer::read(rec.body(), rec.body_bytes(), h.type_version, msg)) return false;
+
+    msg.set_uid(h.uid);
+    msg.cmd = (MSG_CMD)h.cmd;
+    msg.user_data = nullptr;
+    if(h.cmd_bytes){
+        msg.user_data = CmdDataRegistry::decode(rec.cmd_data(), rec.cmd_bytes());
+        if(!msg.user_data) return false;
+    }
+    return true;
+}
+
+/*
+ * The message types that can be restored from a record without knowing the type in
+ * advance (a replay of a recorded stream). The standard packets are registered
+ * when they are used by an edge or the recorder, a user type is registered once:
+ *
+ * MsgTypeRegistry::reg<MyPkt>();
+ */
+class MsgTypeRegistry{
+public:
+    template<typename T>
+    static void reg(){
+        auto& r = instance();
+        std::unique_lock<std::mutex> lck(r.mtx);
+        auto& e = r.types[msg_type_id(MsgSerializer<T>::name())];
+        e.name = MsgSerializer<T>::name();
+        e.read = [](const MsgRecordView& rec) -> std::shared_ptr<BaseMessage> {
+            auto msg = std::make_shared<T>();
+            if(!deserialize(rec, *msg)) return nullptr;
+            return msg;
+        };
+    }
+
+    // null if the type is not registered or the record can't be decoded
+    static std::shared_ptr<BaseMessage> read(const MsgRecordView& rec){
+        auto& r = instance();
+        tReader reader;
+        {
+            std::unique_lock<std::mutex> lck(r.mtx);
+            auto it = r.types.find(rec.header().type_id);
+            if(it == r.types.end()) return nullptr;
+            reader = it->second.read;
+        }
+        return reader(rec);
+    }
+
+    static std::string name(uint32_t type_id){
+        auto& r = instance();
+        std::unique_lock<std::mutex> lck(r.mtx);
+        auto it = r.types.find(type_id);
+        return it == r.types.end() ? std::string() : it->second.name;
+    }
+
+private:
+    using tReader = std::function<std::shared_ptr<BaseMessage>(const MsgRecordView&)>;
+
+    struct Entry{
+        std::string name;
+        tReader read;
+    };
+
+    static MsgTypeRegistry& instance(){
+        static MsgTypeRegistry* r = new MsgTypeRegistry;
+        return *r;
+    }
+
+    std::mutex mtx;
+    std::map<uint32_t, Entry> types;
+};
+
+/*
+ * The body of the packets with a 'std::vector<tElem>' payload, it can be
+ * read in place as an array of tElem.
+ */
+template<typename T, typename tElem, typename tVec, tVec T::*field>
+struct MsgVectorSerializer{
+    static uint16_t version(){return 1;}
+
+    static size_t size(const T& msg){
+        return (msg.*field).size()*sizeof(tElem);
+    }
+
+    static void write(const T& msg, char* dst){
+        if(!(msg.*field).empty()) memcpy(dst, (msg.*field).data(), size(msg));
+    }
+
+    static bool read(const char* src, size_t bytes, uint16_t, T& msg){
+        if(bytes % sizeof(tElem)) return false;
+        // the source can be unaligned (a record inside a datagram)
+        (msg.*field).resize(bytes/sizeof(tElem));
+        if(bytes) memcpy((msg.*field).data(), src, bytes);
+        return true;
+    }
+
+    static const void* view(const T& msg){
+        return (msg.*field).data();
+    }
+};
+
+#endif //DISTPIPELINEFWK_SERIALIZATION_H
@@ -0,0 +1,269 @@
+#ifndef DISTPIPELINEFWK_SPAN_TRACE_H
+#define DISTPIPELINEFWK_SPAN_TRACE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+#include <cstdio>
+
+#include "node_stats.h"
+#include "node_factory.hpp"
+
+/*
+ * Execution trace of the whole graph in the Chrome trace-event JSON format, it
+ * can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing. While the
+ * tracer is enabled each node records:
+ *
+ * - a span for each process_usr_msg call (or a batch, see NodeAttr::batch_size),
+ * named by the node;
+ * - a "wait input" span when it sleeps on the empty input queue;
+ * - a "blocked" span when it is a WAIT producer blocked on a full queue of the
+ * next node;
+ * - a flow arrow from the put of each message to the span where the receiver
+ * processes it, so a message can be followed through the graph.
+ *
+ * SpanTracer::enable();
+ * ... run the graph ...
+ * SpanTracer::disable();
+ * SpanTracer::dump("pipeline.json");
+ *
+ * The events are written into per thread buffers without locks, a thread buffer
+ * is allocated when the thread records it's first event. When a buffer is full
+ * the new events of this thread are discarded (and counted). When the tracer is
+ * disabled each hook costs one relaxed atomic load.
+ */
+class SpanTracer{
+public:
+    enum class KIND : uint8_t {PROCESS, WAIT_INPUT, BLOCKED, FLOW_OUT, FLOW_IN};
+
+    struct Event{
+        KIND kind;
+        // the node that does the work, for BLOCKED - the node that is blocking
+        unsigned int node;
+        uint64_t ts_ns;
+        uint64_t dur_ns;
+        // flow id for the flow events
+        uint64_t id;
+    };
+
+    /*
+     * Start recording, the events recorded before are discarded. A thread can
+     * still be writing into it's old buffer, so the old buffers are retired and
+     * freed here, or by the next enable(), when no thread is inside record().
+     */
+    static void enable(size_t events_per_thread = 1 << 16){
+        auto& tr = instance();
+        std::unique_lock<std::mutex> lck(tr.mtx);
+        for(auto& b : tr.buffers) tr.retired.push_back(std::move(b));
+        tr.buffers.clear();
+        tr.capacity = events_per_thread;
+        tr.generation.fetch_add(1, std::memory_order_seq_cst);
+
+        // a writer that is not busy now will see the new generation, see record()
+        bool busy = false;
+        for(auto& w : tr.writers)
+            busy = busy || w->busy.load(std::memory_order_seq_cst);
+        if(!busy) tr.retired.clear();
+
+        tr.on.store(true, std::memory_order_release);
+    }
+
+    static void disable(){
+        instance().on.store(false, std::memory_order_release);
+    }
+
+    static bool enabled(){
+        return instance().on.load(std::memory_order_relaxed);
+    }
+
+    static void span(KIND kind, unsigned int node, uint64_t t0_ns, uint64_t t1_ns){
+        record(Event{kind, node, t0_ns, t1_ns - t0_ns, 0});
+    }
+
+    // the flow id of a message sent to the node 'to'
+    static uint64_t flow_id(uint64_t msg_uid, unsigned int to){
+        return (msg_uid ^ ((uint64_t)to << 32)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    static void flow(KIND kind, uint64_t id, uint64_t ts_ns){
+        record(Event{kind, 0, ts_ns, 0, id});
+    }
+
+    // the number of events lost because of the full thread buffers
+    static uint64_t lost(){
+        auto& tr = instance();
+        std::unique_lock<std::mutex> lck(tr.mtx);
+        uint64_t n = 0;
+        for(auto& b : tr.buffers) n += b->lost.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    /*
+     * Write the recorded events as a Chrome trace-event JSON. It is safe to dump
+     * while the graph is running, only the events that are completely written
+     * at this moment are exported.
+     */
+    static void dump(std::ostream& os){
+        auto& tr = instance();
+        std::unique_lock<std::mutex> lck(tr.mtx);
+
+        os << "{\"traceEvents\":[";
+        bool first = true;
+        auto sep = [&]{ if(!first) os << ",\n"; first = false; };
+
+        for(size_t t = 0; t < tr.buffers.size(); t++){
+            auto& b = *tr.buffers[t];
+            size_t n = b.n.load(std::memory_order_acquire);
+            auto tid = t + 1;
+
+            // the thread is named by the first node recorded there
+            std::string tname = "thread " + std::to_string(tid);
+            for(size_t i = 0; i < n; i++){
+                if(b.events[i].kind == KIND::PROCESS){
+                    tname = label(b.events[i].node);
+                    break;
+                }
+            }
+            sep();
+            os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+               << ",\"args\":{\"name\":\"" << escape(tname) << "\"}}";
+
+            for(size_t i = 0; i < n; i++){
+                auto& e = b.events[i];
+                sep();
+                switch(e.kind){
+                    case KIND::PROCESS:
+                    case KIND::WAIT_INPUT:
+                    case KIND::BLOCKED:{
+                        std::string name = e.kind == KIND::PROCESS ? label(e.node) :
+                                           e.kind == KIND::WAIT_INPUT ? "wait input" :
+                                           "blocked on " + label(e.node);
+                        os << "{\"name\":\"" << escape(name) << "\",\"cat\":\"node\",\"ph\":\"X\""
+                           << ",\"ts\":" << us(e.ts_ns) << ",\"dur\":" << us(e.dur_ns)
+                           << ",\"pid\":1,\"tid\":" << tid
+                           << ",\"args\":{\"node\":" << e.node << "}}";
+                        break;
+                    }
+                    case KIND::FLOW_OUT:
+                    case KIND::FLOW_IN:
+                        os << "{\"name\":\"msg\",\"cat\":\"msg\",\"ph\":\""
+                           << (e.kind == KIND::FLOW_OUT ? "s" : "f") << "\""
+                           << (e.kind == KIND::FLOW_IN ? ",\"bp\":\"e\"" : "")
+                           << ",\"id\":" << (e.id >> 11)
+                           << ",\"ts\":" << us(e.ts_ns) << ",\"pid\":1,\"tid\":" << tid << "}";
+                        break;
+                }
+            }
+        }
+        os << "],\"displayTimeUnit\":\"ns\"}" << std::endl;
+    }
+
+    static bool dump(const std::string& file){
+        std::ofstream os(file);
+        if(!os) return false;
+        dump(os);
+        return true;
+    }
+
+private:
+    struct Buffer{
+        Buffer(size_t capacity) : events(capacity) {}
+        std::vector<Event> events;
+        std::atomic<size_t> n{0};
+        std::atomic<uint64_t> lost{0};
+    };
+
+    // it is owned by the tracer, so it outlives the thread
+    struct Writer{
+        std::atomic<bool> busy{false};
+    };
+
+    struct Local{
+        uint64_t generation = 0;
+        Buffer* buf = nullptr;
+        Writer* writer = nullptr;
+    };
+
+    static SpanTracer& instance(){
+        static SpanTracer* tr = new SpanTracer;
+        return *tr;
+    }
+
+    static void record(const Event& e){
+        auto& tr = instance();
+        static thread_local Local local;
+
+        if(!local.writer){
+            std::unique_lock<std::mutex> lck(tr.mtx);
+            tr.writers.emplace_back(new Writer);
+            local.writer = tr.writers.back().get();
+        }
+
+        // the old buffer is not freed while the thread is busy, and if enable()
+        // did not see it busy the thread sees the new generation (both seq_cst)
+        local.writer->busy.store(true, std::memory_order_seq_cst);
+        if(!local.buf || local.generation != tr.generation.load(std::memory_order_seq_cst)){
+            std::unique_lock<std::mutex> lck(tr.mtx);
+            tr.buffers.emplace_back(new Buffer(tr.capacity));
+            local.buf = tr.buffers.back().get();
+            local.generation = tr.generation.load(std::memory_order_relaxed);
+        }
+
+        auto& b = *local.buf;
+        auto n = b.n.load(std::memory_order_relaxed);
+        if(n == b.events.size()){
+            b.lost.fetch_add(1, std::memory_order_relaxed);
+        }else{
+            b.events[n] = e;
+            b.n.store(n + 1, std::memory_order_release);
+        }
+        local.writer->busy.store(false, std::memory_order_release);
+    }
+
+    static std::string label(unsigned int uid){
+        auto name = NodeFactory::node_name(uid);
+        return name.empty() ? std::to_string(uid) : name;
+    }
+
+    static std::string us(uint64_t ns){
+        return std::to_string(ns/1000) + "." + std::to_string(ns%1000/100) + std::to_string(ns%100/10) + std::to_string(ns%10);
+    }
+
+    static std::string escape(const std::string& s){
+        std::string out;
+        for(auto c : s){
+            if(c == '"' || c == '\\'){
+                out += '\\';
+                out += c;
+            }else if((unsigned char)c < 0x20){
+                char hex[8];
+                snprintf(hex, sizeof(hex), "\\u%04x", (unsigned)c);
+                out += hex;
+            }else{
+                out += c;
+            }
+        }
+        return out;
+    }
+
+private:
+    std::atomic<bool> on{false};
+    std::atomic<uint64_t> generation{0};
+    size_t capacity = 1 << 16;
+
+    // the buffers of the current generation, the old ones are kept in 'retired'
+    // until no thread can write into them (see enable)
+    std::mutex mtx;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<std::unique_ptr<Buffer>> retired;
+
+    // one per thread that has recorded anything
+    std::vector<std::unique_ptr<Writer>> writers;
+};
+
+#endif //DISTPIPELINEFWK_SPAN_TRACE_H
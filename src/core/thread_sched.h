@@ -0,0 +1,105 @@
+#ifndef DISTPIPELINEFWK_THREAD_SCHED_H
+#define DISTPIPELINEFWK_THREAD_SCHED_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/*
+ * OTHER - the default time sharing scheduler, 'priority' shell be zero;
+ * FIFO, RR - real-time policies, 'priority' is 1..99, the process needs
+ * CAP_SYS_NICE (or an rtprio limit) to use them.
+ */
+enum class SCHED_POLICY{OTHER, FIFO, RR};
+
+/*
+ * Placement of the node thread, see NodeAttr::sched. An acquisition source
+ * and the first decoding filter can be pinned to the isolated cores and run
+ * with a real-time priority, so the packets are not lost when the other nodes
+ * load the CPU:
+ *
+ * NodeAttr a;
+ * a.sched.cpus = {3};
+ * a.sched.policy = SCHED_POLICY::FIFO;
+ * a.sched.priority = 80;
+ * auto udp = NodeFactory::create_with<UDPSource<>>(a, "192.168.1.50:1234");
+ *
+ * numa_node sets the preferred memory node of the thread, the messages and
+ * buffers allocated by the node (MsgPool, DSP workspaces) are placed there.
+ */
+struct SchedAttr{
+    // the CPUs the thread may run on, empty - any CPU
+    std::vector<int> cpus;
+
+    SCHED_POLICY policy = SCHED_POLICY::OTHER;
+    int priority = 0;
+
+    // preferred NUMA node for the allocations, -1 - the system default
+    int numa_node = -1;
+
+    bool is_default() const {
+        return cpus.empty() && policy == SCHED_POLICY::OTHER && priority == 0 && numa_node < 0;
+    }
+};
+
+/*
+ * Apply the attributes to the calling thread. Each failure is reported and the
+ * rest of the attributes are still applied, returns false if any has failed.
+ */
+inline bool apply_thread_sched(const SchedAttr& s, const std::string& name){
+#ifdef __linux__
+    bool ok = true;
+
+    if(!s.cpus.empty()){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(auto cpu : s.cpus)
+            if(cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(err){
+            std::cerr << name << " warning: can't set CPU affinity: " << strerror(err) << std::endl;
+            ok = false;
+        }
+    }
+
+    int policy = s.policy == SCHED_POLICY::FIFO ? SCHED_FIFO :
+                 s.policy == SCHED_POLICY::RR ? SCHED_RR : SCHED_OTHER;
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = s.priority;
+    int err = pthread_setschedparam(pthread_self(), policy, &param);
+    if(err){
+        std::cerr << name << " warning: can't set scheduling policy: " << strerror(err) << std::endl;
+        ok = false;
+    }
+
+    if(s.numa_node >= 0){
+        // set_mempolicy(MPOL_PREFERRED) without the libnuma dependency
+        const int mpol_preferred = 1;
+        const unsigned long bits = 8*sizeof(unsigned long);
+        std::vector<unsigned long> mask(s.numa_node/bits + 1, 0);
+        mask[s.numa_node/bits] = 1ul << (s.numa_node % bits);
+        if(syscall(SYS_set_mempolicy, mpol_preferred, mask.data(), mask.size()*bits + 1) != 0){
+            std::cerr << name << " warning: can't set NUMA node " << s.numa_node
+                      << ": " << strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+#else
+    if(!s.is_default())
+        std::cerr << name << " warning: scheduling attributes are not supported on this platform" << std::endl;
+    return s.is_default();
+#endif
+}
+
+#endif //DISTPIPELINEFWK_THREAD_SCHED_H
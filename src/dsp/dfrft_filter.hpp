@@ -9,6 +9,7 @@
 #include <gsl/gsl_matrix.h>
 
 #include "base_filter.hpp"
+#include "msg_pool.hpp"
 #include "dfrft_gsl.h"
 
 template<typename tIn, typename tOut>
@@ -41,7 +42,7 @@ public:
         }
 
         // apply when arrived
-        virtual void apply(CommandNode* ptr){
+        virtual void apply(CommandNode* ptr) const {
             auto filter = dynamic_cast<DFrFTFilter<tIn, tOut> *>(ptr);
             if (!filter) return;
             // apply only if current 'a' is not the same
@@ -77,9 +78,10 @@ protected:
         if(!Ec || Ec->size1 != N) create_basis(N);
         if(!Fa) init_transform(a);
 
-        tPtrOut out_msg(new typename tPtrOut::element_type);
+        auto out_msg = MsgPool<typename tPtrOut::element_type>::acquire();
+        make_writable(msg);
         dfrft(msg->data);
-        out_msg->data = std::move(msg->data);
+        out_msg->data.swap(msg->data);
         return out_msg;
     }
 
@@ -10,6 +10,7 @@
 
 #include "data_packet_types.h"
 #include "base_filter.hpp"
+#include "msg_pool.hpp"
 #include "dft_periodic.h"
 
 template<typename tIn, typename tOut>
@@ -46,16 +47,18 @@ protected:
         if(!is_initialized(N, ctx_type))
                 initialize(N, ctx_type);
 
-        tPtrOut out_msg(new typename tPtrOut::element_type);
+        auto out_msg = MsgPool<typename tPtrOut::element_type>::acquire();
+        make_writable(in_msg);
 
         /*
          * The transform result is written into the vector of in_msg.
          * If input context type is REAL, the size of in_msg->data will be doubled to
          * store complex numbers. If the context is COMPLEX, than original vector
-         * size will not change.
+         * size will not change. The vectors are swapped, so the recycled
+         * in_msg keeps the buffer of out_msg.
          */
         dft(in_msg->data, ctx_type);
-        out_msg->data = std::move(in_msg->data);
+        out_msg->data.swap(in_msg->data);
         return out_msg;
     }
 };
@@ -53,10 +53,10 @@ DFT::dft(vector<double>& s, CONTEXT_TYPE in_ctx_type){
     if(!is_initialized(N, in_ctx_type)) throw runtime_error("DFT: REAL context not initialized");
 
     if(in_ctx_type == REAL) {
-        std::vector<double> out(2 * N);
+        buf.resize(2 * N);
         gsl_fft_real_transform(s.data(), 1, N, real_wavetable.get(), real_workspace.get());
-        gsl_fft_halfcomplex_unpack(s.data(), out.data(), 1, N);
-        s = move(out);
+        gsl_fft_halfcomplex_unpack(s.data(), buf.data(), 1, N);
+        s.swap(buf);
     }else if(in_ctx_type == COMPLEX){
         gsl_fft_complex_forward(s.data(), 1, N, complex_wavetable.get(), complex_workspace.get());
     }
@@ -73,9 +73,9 @@ DFT::ift(std::vector<double>& S, CONTEXT_TYPE out_ctx_type){
     gsl_fft_complex_inverse(S.data(), 1, N, complex_wavetable.get(),complex_workspace.get());
 
     if(out_ctx_type == REAL){
-        std::vector<double> out(N);
+        buf.resize(N);
         for(size_t i = 0; i < N; i++)
-            out[i] = S.data()[2*i];
-        S = move(out);
+            buf[i] = S.data()[2*i];
+        S.swap(buf);
     }
 }
\ No newline at end of file
@@ -57,6 +57,15 @@ protected:
     tWorkspace real_workspace;
     tPtrComplexWavetable complex_wavetable;
     tPtrComplexWorkspace complex_workspace;
+
+private:
+    /*
+     * When the vector size changes, the result is written here and swapped
+     * with the input vector, the input buffer stays here for the next call.
+     * With the pooled messages (see MsgPool) the both vectors keep their
+     * capacity and no allocation is done at the steady state.
+     */
+    std::vector<double> buf;
 };
 
 #endif //DISTPIPELINEFWK_CONTEXT_FFT_H
@@ -10,6 +10,7 @@
 
 #include "data_packet_types.h"
 #include "base_filter.hpp"
+#include "msg_pool.hpp"
 #include "dft_periodic.h"
 
 template<typename tIn, typename tOut>
@@ -39,7 +40,8 @@ protected:
         if(!is_initialized(N, COMPLEX))
             initialize(N, COMPLEX);
 
-        tPtrOut out_msg(new typename tPtrOut::element_type);
+        auto out_msg = MsgPool<typename tPtrOut::element_type>::acquire();
+        make_writable(in_msg);
 
         /*
          * The transform result is written into the vector of in_msg.
@@ -48,7 +50,7 @@ protected:
          */
         CONTEXT_TYPE ctx_type = is_real_output ? REAL : COMPLEX;
         ift(in_msg->data, ctx_type);
-        out_msg->data = std::move(in_msg->data);
+        out_msg->data.swap(in_msg->data);
         return out_msg;
     }
 };
@@ -11,6 +11,7 @@
 
 #include "data_packet_types.h"
 #include "base_filter.hpp"
+#include "msg_pool.hpp"
 
 /*
  * Depending on the PowerFilter::MODE switch the output can be |s(k)|, |s^2(k)|, 
@@ -37,12 +38,13 @@ public:
 private:
     // real input data
     tPtrOut proc_r(tPtrIn &&in_msg) {
-        auto out_msg = tPtrOut(new tOut);
-        out_msg->data = std::move(in_msg->data);
+        auto out_msg = MsgPool<tOut>::acquire();
+        make_writable(in_msg);
+        out_msg->data.swap(in_msg->data);
 
         double p = mode == MODE::MAG ? 1.0 : 2.0;
         double sum = 0.0;
-        for (int i = 0; i < in_msg->data.size(); i++) {
+        for (int i = 0; i < out_msg->data.size(); i++) {
             out_msg->data[i] = pow(out_msg->data[i], p);
             sum += out_msg->data[i];
         }
@@ -56,7 +58,7 @@ private:
     // complex input data
     tPtrOut proc_c(tPtrIn &&in_msg) {
         auto N = in_msg->data.size() / 2;
-        auto out_msg = tPtrOut(new tOut);
+        auto out_msg = MsgPool<tOut>::acquire();
 
         out_msg->data.resize(N);
         double p = mode == MODE::MAG ? 1.0 : 2.0;
@@ -10,6 +10,7 @@
 #include "dft_periodic.h"
 #include "data_packet_types.h"
 #include "base_filter.hpp"
+#include "msg_pool.hpp"
 
 template<typename tIn>
 class FilterQuadrature : public BaseFilter<tIn, tIn>, public DFT{
@@ -32,9 +33,10 @@ protected:
         // todo: remove constant component?
 
         // store original input signal
-        std::vector<double> cpy = in_msg->data;
+        cpy.assign(in_msg->data.begin(), in_msg->data.end());
 
         // fourier transform result is complex vector of size 2*N
+        make_writable(in_msg);
         dft(in_msg->data, REAL);
 
         // ft is just an alias to in_msg->data
@@ -55,7 +57,8 @@ protected:
         // but imaginary part of each point is nearly zero
         ift(ft, COMPLEX);
 
-        tPtrOut out_msg(new typename tPtrOut::element_type(*in_msg.get()));
+        auto out_msg = MsgPool<typename tPtrOut::element_type>::acquire();
+        out_msg->init_attached_data(*in_msg);
         out_msg->data.resize(N);
 
         // quadrature magnitude
@@ -65,6 +68,9 @@ protected:
         return out_msg;
     }
 
+private:
+    // a copy of the input signal, reused between the frames
+    std::vector<double> cpy;
 };
 
 #endif //DISTPIPELINEFWK_QUADRATURE_FILTER_H
@@ -0,0 +1,365 @@
+/*
+ * Core engine benchmark: throughput, latency and losses of the basic nodes.
+ *
+ * The messages are sent by the main thread as fast as possible into the measured
+ * graph, each one carries it's send time, the device at the end of the graph
+ * records the latency. The topologies are:
+ *
+ * node - main thread -> device (BaseNode);
+ * chain - main thread -> L filters (BaseFilter) -> device;
+ * split - main thread -> splitter (BaseSplitter) -> W devices, the payload is
+ * copied for each target or shared (split/shared rows);
+ * join - main thread -> splitter -> W filters -> join (BaseSyncJoin) -> device;
+ * overload - main thread -> filter that spends 'work' ns per message -> device,
+ * the graph is slower than the producer, with DROP the losses are measured;
+ * hop - main thread -> L filters -> device on the ring queues, the messages are
+ * sent one by one 20 us apart, so the latency is the wakeup cost of the hops
+ * and not the queueing. It is run with each WAIT_STRATEGY (hop/block, hop/spin,
+ * hop/poll), BUSY_POLL needs a free core per node to show it's real latency.
+ *
+ * Each case is run with the WAIT and the DROP policies, the payload is 8 bytes
+ * to 1 MB. The overload is also run with DROP_OLDEST and COALESCE_LATEST, they
+ * trade the losses for the latency of the delivered messages. With DROP a
+ * message can be lost anywhere in the graph, the drop ratio is
+ * 1 - received/expected. The throughput is the number of received messages
+ * per second from the first send to the last reception.
+ *
+ * usage: bench_core [number of messages] [json file] [trace file]
+ *
+ * The results are printed and written as JSON (bench_core.json by default), so
+ * the runs before and after a queue or executor change can be compared. The JSON
+ * also holds the metrics of each node (NodeFactory::stats_snapshot): the drops
+ * by reason, the blocked time, the queue high water and the processing time.
+ * One more join case (join/traced) is run with SpanTracer enabled, it's trace
+ * is written to the trace file (bench_core_trace.json by default), it can be
+ * opened in Perfetto or chrome://tracing.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <string>
+#include <cstdlib>
+
+#include "base_filter.hpp"
+#include "base_splitter.hpp"
+#include "base_sync_join.hpp"
+#include "msg_pool.hpp"
+#include "span_trace.h"
+
+using namespace std;
+using namespace std::chrono;
+
+struct BenchPkt : public BaseMessage{
+    BenchPkt(){}
+    BenchPkt(const BenchPkt& msg) : BaseMessage(msg), sent_ns{msg.sent_ns}, payload{msg.payload} {}
+
+    virtual size_t payload_size() const {
+        return payload.size();
+    }
+
+    virtual void recycle(){
+        BaseMessage::recycle();
+        payload.clear();
+    }
+
+    uint64_t sent_ns = 0;
+    vector<char> payload;
+};
+
+using tFilter = BaseFilter<BenchPkt, BenchPkt>;
+using tSplitter = BaseSplitter<BenchPkt>;
+using tSyncJoin = BaseSyncJoin<BenchPkt>;
+using tDevice = BaseNode<BenchPkt>;
+
+struct Result{
+    string topology;
+    QUEUE_POLICY pol;
+    size_t payload;
+    size_t width;
+    size_t length;
+    uint64_t sent;
+    uint64_t expected;
+    uint64_t received;
+    double sec;
+    HistogramSnapshot latency;
+};
+
+/*
+ * The state of the running case, it is shared by all devices.
+ */
+struct Probe{
+    atomic<uint64_t> received{0};
+    atomic<uint64_t> last_ns{0};
+    LatencyHistogram latency;
+
+    bool on_msg(shared_ptr<BenchPkt>&& msg){
+        auto now = stats_now_ns();
+        latency.record(now - msg->sent_ns);
+        last_ns.store(now, memory_order_relaxed);
+        received.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+};
+
+const char* policy_name(QUEUE_POLICY pol){
+    switch(pol){
+        case QUEUE_POLICY::WAIT: return "WAIT";
+        case QUEUE_POLICY::DROP: return "DROP";
+        case QUEUE_POLICY::DROP_OLDEST: return "DROP_OLDEST";
+        case QUEUE_POLICY::COALESCE_LATEST: return "COALESCE_LATEST";
+        case QUEUE_POLICY::DROP_STALE: return "DROP_STALE";
+    }
+    return "?";
+}
+
+unique_ptr<Probe> probe;
+vector<Result> results;
+
+tDevice::tPtrIn make_msg(size_t payload){
+    auto msg = MsgPool<BenchPkt>::acquire();
+    msg->payload.resize(payload);
+    msg->sent_ns = stats_now_ns();
+    return msg;
+}
+
+shared_ptr<tDevice> make_device(const NodeAttr& attr = NodeAttr()){
+    return NodeFactory::create_with<tDevice>(attr, [](shared_ptr<BenchPkt>&& msg){
+        return probe->on_msg(move(msg));
+    }, "dev");
+}
+
+shared_ptr<tFilter> make_filter(QUEUE_POLICY pol, uint64_t work_ns = 0, const NodeAttr& attr = NodeAttr()){
+    return NodeFactory::create_with<tFilter>(attr, [work_ns](shared_ptr<BenchPkt>&& msg){
+        if(work_ns){
+            auto until = stats_now_ns() + work_ns;
+            while(stats_now_ns() < until);
+        }
+        return move(msg);
+    }, pol, "filter");
+}
+
+/*
+ * Send n messages into 'first' ('gap_ns' apart) and wait until 'expected' messages
+ * are received, or nothing arrives for 200 ms (the rest is lost).
+ */
+template<typename tNode>
+void run(Result r, tNode first, long n, uint64_t gap_ns = 0){
+    probe->received = 0;
+    auto t0 = stats_now_ns();
+    for(long i = 0; i < n; i++){
+        first->put(make_msg(r.payload), 0, r.pol);
+        if(gap_ns){
+            auto until = t0 + (i + 1)*gap_ns;
+            while(stats_now_ns() < until) this_thread::yield();
+        }
+    }
+
+    uint64_t seen = 0;
+    auto idle_since = steady_clock::now();
+    while(probe->received < r.expected){
+        this_thread::sleep_for(microseconds(100));
+        if(probe->received != seen){
+            seen = probe->received;
+            idle_since = steady_clock::now();
+        }else if(steady_clock::now() - idle_since > milliseconds(200)){
+            break;
+        }
+    }
+
+    r.sent = n;
+    r.received = probe->received;
+    r.sec = r.received ? (probe->last_ns - t0)*1e-9 : 0.0;
+    r.latency = probe->latency.snapshot();
+    results.push_back(r);
+
+    cout << setw(12) << r.topology << setw(16) << policy_name(r.pol)
+         << setw(9) << r.payload << " B" << setw(4) << r.width << setw(4) << r.length
+         << setw(12) << (long)(r.sec > 0 ? r.received/r.sec : 0) << " msg/s"
+         << setw(10) << r.latency.percentile(0.5) << setw(12) << r.latency.percentile(0.99) << " ns"
+         << setw(8) << fixed << setprecision(3) << 1.0 - (double)r.received/r.expected << endl;
+}
+
+Result make_result(const char* topology, QUEUE_POLICY pol, size_t payload, size_t width, size_t length,
+                   uint64_t expected){
+    probe.reset(new Probe);
+    Result r;
+    r.topology = topology;
+    r.pol = pol;
+    r.payload = payload;
+    r.width = width;
+    r.length = length;
+    r.expected = expected;
+    return r;
+}
+
+// the large messages are sent less times, about 256 MB per case
+long scaled(long n, size_t payload){
+    return max(256l, min(n, (long)((1ul << 28)/max<size_t>(payload, 1))));
+}
+
+void bench_node(QUEUE_POLICY pol, size_t payload, long n){
+    n = scaled(n, payload);
+    auto r = make_result("node", pol, payload, 1, 0, n);
+    auto dev = make_device();
+    run(r, dev, n);
+    dev->stop();
+}
+
+void bench_chain(QUEUE_POLICY pol, size_t payload, size_t length, long n, uint64_t work_ns = 0){
+    n = scaled(n, payload);
+    auto r = make_result(work_ns ? "overload" : "chain", pol, payload, 1, length, n);
+
+    vector<shared_ptr<tFilter>> filters;
+    for(size_t i = 0; i < length; i++) filters.push_back(make_filter(pol, work_ns));
+    auto dev = make_device();
+    for(size_t i = 0; i + 1 < length; i++) filters[i]->set_target(filters[i + 1]);
+    filters.back()->set_target(dev);
+
+    run(r, filters.front(), n);
+    for(auto& f : filters) f->stop();
+    dev->stop();
+}
+
+void bench_split(QUEUE_POLICY pol, size_t payload, size_t width, bool shared, long n){
+    n = scaled(n, payload*width);
+    auto r = make_result(shared ? "split/shared" : "split", pol, payload, width, 0, n*width);
+
+    auto split = NodeFactory::create<tSplitter>(pol, "splitter", shared);
+    vector<shared_ptr<tDevice>> devs;
+    for(size_t i = 0; i < width; i++){
+        devs.push_back(make_device());
+        split->add_target(devs.back());
+    }
+
+    run(r, split, n);
+    split->stop();
+    for(auto& d : devs) d->stop();
+}
+
+void bench_join(QUEUE_POLICY pol, size_t payload, size_t width, long n, const char* topology = "join"){
+    n = scaled(n, payload*width);
+    auto r = make_result(topology, pol, payload, width, 0, n);
+
+    auto split = NodeFactory::create<tSplitter>(pol, "splitter");
+    auto join = NodeFactory::create<tSyncJoin>([](tSyncJoin::tPtrMsgBlock&& block){
+        return static_pointer_cast<BenchPkt>(block->begin()->second);
+    }, pol, "join");
+    auto dev = make_device();
+
+    vector<shared_ptr<tFilter>> filters;
+    for(size_t i = 0; i < width; i++){
+        filters.push_back(make_filter(pol));
+        join->reg_source_uid(filters.back()->get_uid());
+        split->add_target(filters.back());
+        filters.back()->set_target(tSyncJoin::adaptor<BenchPkt>(join));
+    }
+    join->set_target(dev);
+
+    run(r, split, n);
+    split->stop();
+    for(auto& f : filters) f->stop();
+    join->stop();
+    dev->stop();
+}
+
+void bench_hop(WAIT_STRATEGY ws, size_t length, long n){
+    const char* names[] = {"hop/block", "hop/spin", "hop/poll"};
+    auto r = make_result(names[(int)ws], QUEUE_POLICY::WAIT, 8, 1, length, n);
+
+    NodeAttr attr;
+    attr.queue_type = QUEUE_TYPE::AUTO;
+    attr.wait_strategy = ws;
+
+    vector<shared_ptr<tFilter>> filters;
+    for(size_t i = 0; i < length; i++) filters.push_back(make_filter(QUEUE_POLICY::WAIT, 0, attr));
+    auto dev = make_device(attr);
+    for(size_t i = 0; i + 1 < length; i++) filters[i]->set_target(filters[i + 1]);
+    filters.back()->set_target(dev);
+
+    // the ring queues are allocated at start, when the upstream is known
+    for(auto& f : filters){ f->stop(); f->start(); }
+    dev->stop();
+    dev->start();
+
+    run(r, filters.front(), n, 20000);
+    for(auto& f : filters) f->stop();
+    dev->stop();
+}
+
+void write_json(const string& file, long n){
+    ofstream out(file);
+    out << "{\"bench\":\"bench_core\",\"messages\":" << n << ",\"results\":[";
+    for(size_t i = 0; i < results.size(); i++){
+        auto& r = results[i];
+        out << (i ? "," : "") << "\n{\"topology\":\"" << r.topology << "\""
+            << ",\"policy\":\"" << policy_name(r.pol) << "\""
+            << ",\"payload\":" << r.payload << ",\"width\":" << r.width << ",\"length\":" << r.length
+            << ",\"sent\":" << r.sent << ",\"expected\":" << r.expected << ",\"received\":" << r.received
+            << ",\"drop_ratio\":" << 1.0 - (double)r.received/r.expected
+            << ",\"msgs_per_s\":" << (r.sec > 0 ? r.received/r.sec : 0.0)
+            << ",\"latency_ns\":{\"p50\":" << r.latency.percentile(0.5)
+            << ",\"p90\":" << r.latency.percentile(0.9)
+            << ",\"p99\":" << r.latency.percentile(0.99)
+            << ",\"p999\":" << r.latency.percentile(0.999)
+            << ",\"max\":" << r.latency.max
+            << ",\"mean\":" << r.latency.mean() << "}}";
+    }
+
+    // the nodes of all cases, each case creates it's own nodes
+    out << "\n],\"nodes\":[";
+    auto nodes = NodeFactory::stats_snapshot();
+    for(size_t i = 0; i < nodes.size(); i++){
+        auto& s = nodes[i];
+        out << (i ? "," : "") << "\n{\"uid\":" << s.uid << ",\"name\":\"" << s.name << "\""
+            << ",\"msgs_in\":" << s.msgs_in << ",\"msgs_out\":" << s.msgs_out
+            << ",\"processed\":" << s.processed << ",\"drops\":{";
+        for(size_t k = 0; k < (size_t)DROP_REASON::COUNT; k++)
+            out << (k ? "," : "") << "\"" << drop_reason_name((DROP_REASON)k) << "\":" << s.drops[k];
+        out << "},\"blocked\":" << s.blocked << ",\"blocked_ns\":" << s.blocked_ns
+            << ",\"high_water\":" << s.high_water
+            << ",\"proc_ns\":{\"p50\":" << s.proc_time.percentile(0.5)
+            << ",\"p99\":" << s.proc_time.percentile(0.99)
+            << ",\"max\":" << s.proc_time.max << "}}";
+    }
+    out << "\n]}" << endl;
+}
+
+int main(int argc, char** argv){
+    long n = argc > 1 ? atol(argv[1]) : 200000;
+    string json = argc > 2 ? argv[2] : "bench_core.json";
+    string trace = argc > 3 ? argv[3] : "bench_core_trace.json";
+
+    cout << "messages: " << n << endl;
+    cout << "topology, policy, payload, width, length, received msg/s, latency p50, p99, drop ratio" << endl;
+
+    const size_t payloads[] = {8, 1024, 65536, 1 << 20};
+    for(auto pol : {QUEUE_POLICY::WAIT, QUEUE_POLICY::DROP}){
+        for(auto p : payloads) bench_node(pol, p, n);
+        for(size_t len : {1, 4, 16}) bench_chain(pol, 1024, len, n);
+        for(auto p : payloads)
+            for(size_t w : {2, 4, 8}) bench_split(pol, p, w, false, n);
+        for(size_t w : {2, 4, 8}) bench_split(pol, 65536, w, true, n);
+        for(size_t w : {2, 4}) bench_join(pol, 1024, w, n);
+        bench_chain(pol, 1024, 1, n/10, 2000);
+    }
+    for(auto pol : {QUEUE_POLICY::DROP_OLDEST, QUEUE_POLICY::COALESCE_LATEST})
+        bench_chain(pol, 1024, 1, n/10, 2000);
+    for(auto ws : {WAIT_STRATEGY::BLOCK, WAIT_STRATEGY::SPIN_PARK, WAIT_STRATEGY::BUSY_POLL})
+        for(size_t len : {1, 4}) bench_hop(ws, len, n/20);
+
+    // a short case, the trace buffers hold 64K events per thread
+    SpanTracer::enable();
+    bench_join(QUEUE_POLICY::WAIT, 1024, 2, 2000, "join/traced");
+    SpanTracer::disable();
+    if(!SpanTracer::dump(trace)) cerr << "can't write " << trace << endl;
+
+    write_json(json, n);
+    cout << "written " << json << " and " << trace << endl;
+    return 0;
+}
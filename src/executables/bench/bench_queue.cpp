@@ -0,0 +1,151 @@
+/*
+ * Input queue benchmark: the same pipeline is run with the std::list input
+ * queue and with the lock-free rings (see QUEUE_TYPE in core/command_node.h).
+ *
+ * Two topologies are measured:
+ *
+ * chain - main thread -> filter -> filter -> device, each node has exactly one
+ * upstream, so QUEUE_TYPE::AUTO selects RING_SPSC;
+ *
+ * fan-in - P producer threads -> device, the device queue has many producers
+ * and only RING_MPSC (or LIST) can be used.
+ *
+ * All messages are sent with QUEUE_POLICY::WAIT, so nothing is lost and the
+ * throughput is limited by the queues and thread wakeups only. The "chain/2"
+ * rows wake the blocked producers with hysteresis, at the half of the queue,
+ * the "chain/b8" rows additionally drain the queues in batches of 8 messages
+ * and the "pool" rows run the same chain on the work-stealing pool.
+ *
+ * usage: bench_queue [number of messages]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+
+#include "base_filter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+struct BenchMsg : public BaseMessage{
+    BenchMsg(){}
+    BenchMsg(const BenchMsg& msg) : BaseMessage(msg){ val = msg.val; }
+    long val = 0;
+};
+
+using tFilter = BaseFilter<BenchMsg, BenchMsg>;
+using tDevice = BaseNode<BenchMsg>;
+
+atomic<long> received{0};
+
+shared_ptr<BenchMsg> filter_proc(shared_ptr<BenchMsg>&& msg){
+    msg->val++;
+    return msg;
+}
+
+bool dev_proc(shared_ptr<BenchMsg>&&){
+    received++;
+    return true;
+}
+
+void wait_received(long n){
+    while(received < n) this_thread::yield();
+}
+
+const char* queue_name(QUEUE_TYPE t){
+    switch(t){
+        case QUEUE_TYPE::LIST: return "LIST";
+        case QUEUE_TYPE::RING_SPSC: return "RING_SPSC";
+        case QUEUE_TYPE::RING_MPSC: return "RING_MPSC";
+        case QUEUE_TYPE::AUTO: return "AUTO";
+    }
+    return "";
+}
+
+void report(const char* topology, QUEUE_TYPE t, long n, steady_clock::duration dt){
+    double sec = duration_cast<duration<double>>(dt).count();
+    cout << setw(8) << topology << setw(12) << queue_name(t)
+         << setw(14) << (long)(n/sec) << " msg/s" << endl;
+}
+
+void bench_chain(const char* label, QUEUE_TYPE t, long n, double low_watermark = 1.0, size_t batch = 1,
+                 EXEC_MODE mode = EXEC_MODE::THREAD){
+    NodeAttr attr;
+    attr.exec_mode = mode;
+    attr.queue_type = t;
+    attr.max_msgs = 16;
+    attr.low_watermark = low_watermark;
+    attr.batch_size = batch;
+
+    auto f1 = NodeFactory::create_with<tFilter>(attr, filter_proc, QUEUE_POLICY::WAIT, "f1");
+    auto f2 = NodeFactory::create_with<tFilter>(attr, filter_proc, QUEUE_POLICY::WAIT, "f2");
+    auto dev = NodeFactory::create_with<tDevice>(attr, dev_proc, "dev");
+    f1->set_target(f2);
+    f2->set_target(dev);
+
+    // AUTO is resolved when the node starts, 'create' has started them before the wiring
+    f1->stop(); f2->stop(); dev->stop();
+    dev->start(); f2->start(); f1->start();
+
+    received = 0;
+    auto t0 = steady_clock::now();
+    for(long i = 0; i < n; i++)
+        f1->put(shared_ptr<BenchMsg>(new BenchMsg), 0, QUEUE_POLICY::WAIT);
+    wait_received(n);
+    report(label, t, n, steady_clock::now() - t0);
+
+    f1->stop(); f2->stop(); dev->stop();
+}
+
+void bench_fan_in(QUEUE_TYPE t, long n, int producers){
+    NodeAttr attr;
+    attr.queue_type = t;
+    attr.max_msgs = 16;
+
+    auto dev = NodeFactory::create_with<tDevice>(attr, dev_proc, "dev");
+
+    received = 0;
+    auto t0 = steady_clock::now();
+    vector<thread> threads;
+    for(int p = 0; p < producers; p++)
+        threads.push_back(thread([&dev, n, producers]{
+            for(long i = 0; i < n/producers; i++)
+                dev->put(shared_ptr<BenchMsg>(new BenchMsg), 0, QUEUE_POLICY::WAIT);
+        }));
+    for(auto& th : threads) th.join();
+    wait_received(n/producers*producers);
+    report("fan-in", t, n/producers*producers, steady_clock::now() - t0);
+
+    dev->stop();
+}
+
+int main(int argc, char** argv){
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+
+    cout << "messages: " << n << endl;
+    bench_chain("chain", QUEUE_TYPE::LIST, n);
+    bench_chain("chain", QUEUE_TYPE::RING_SPSC, n);
+    bench_chain("chain", QUEUE_TYPE::RING_MPSC, n);
+
+    // WAIT producers are woken when the queue is half empty (see NodeAttr::low_watermark)
+    bench_chain("chain/2", QUEUE_TYPE::LIST, n, 0.5);
+    bench_chain("chain/2", QUEUE_TYPE::RING_SPSC, n, 0.5);
+
+    // up to 8 messages are drained per wakeup (see NodeAttr::batch_size)
+    bench_chain("chain/b8", QUEUE_TYPE::LIST, n, 0.5, 8);
+    bench_chain("chain/b8", QUEUE_TYPE::RING_SPSC, n, 0.5, 8);
+
+    // nodes are tasks of the work-stealing pool (see EXEC_MODE)
+    bench_chain("pool", QUEUE_TYPE::LIST, n, 0.5, 8, EXEC_MODE::POOL);
+    bench_chain("pool", QUEUE_TYPE::RING_SPSC, n, 0.5, 8, EXEC_MODE::POOL);
+
+    bench_fan_in(QUEUE_TYPE::LIST, n, 4);
+    bench_fan_in(QUEUE_TYPE::RING_MPSC, n, 4);
+
+    return 0;
+}
@@ -31,6 +31,10 @@ struct BIN_PKT : public BaseMessage{
         measure_time = pkt.measure_time;
     }
 
+    virtual size_t payload_size() const {
+        return bin_frame.size();
+    }
+
     std::vector<char> bin_frame; //data
     double t_adq; //measured acquisition time
     double measure_time; //full time of data array (x-axis)
@@ -154,6 +158,7 @@ protected:
 
             //send data to the next processing node
             if(next){
+                stamp(*pkt);
                 next->put(move(pkt), this->uid, pol);
             }else{
                 pkt.reset();
@@ -26,9 +26,15 @@ int main(int argc, char** argv){
 
     using tOsc = GenOscDevice<RealSignalPkt>;
 
+    // the latency of the plant -> monitor -> PID path is traced (see msg_trace.h),
+    // the percentiles are printed at exit
+    NodeAttr trace_start, trace_sink;
+    trace_start.trace_start = true;
+    trace_sink.trace_sink = true;
+
     // DSP
     auto sys_monitor = NodeFactory::create<SysMonitorFilter>();
-    auto pid_filter = NodeFactory::create<PIDFilter>(QUEUE_POLICY::WAIT);
+    auto pid_filter = NodeFactory::create_with<PIDFilter>(trace_sink, QUEUE_POLICY::WAIT);
 
     // devices
     auto err_osc = NodeFactory::create<tOsc>("T_in");
@@ -37,12 +43,12 @@ int main(int argc, char** argv){
 
 #ifdef EXPERIMENT
     auto hw_peltier = NodeFactory::create<PeltierHardwareFilter>("/dev/ttyACM0");
-    auto hw_decoder = NodeFactory::create<HWStateTracker>();
+    auto hw_decoder = NodeFactory::create_with<HWStateTracker>(trace_start);
     hw_peltier->set_target(hw_decoder);
     hw_decoder->set_target(sys_monitor);
     pid_filter->set_target(hw_peltier);
 #else
-    auto software_peltier = NodeFactory::create<PeltierModelFilter>();
+    auto software_peltier = NodeFactory::create_with<PeltierModelFilter>(trace_start);
     software_peltier->set_target(sys_monitor);
     pid_filter->set_target(software_peltier);
 #endif
@@ -65,4 +71,6 @@ int main(int argc, char** argv){
         this_thread::sleep_for(chrono::milliseconds(40));
     }
 
+    TraceAggregator::global().report(cout);
+
 }
@@ -79,6 +79,8 @@ SysMonitorFilter::process_usr_msg(tPtrIn&& msg){
             pid_msg->calibrate = false;
         }
 
+        // the loop latency is traced up to the PID controller (see pid.cpp)
+        pid_msg->trace = msg->trace;
         PIDController->put(move(pid_msg), this->uid, QUEUE_POLICY::WAIT);
 
     }
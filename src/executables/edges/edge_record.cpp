@@ -0,0 +1,83 @@
+/*
+ * Recording and replay of an edge (see sources/stream_record.hpp). The frames
+ * that pass the edge are appended to a file by StreamRecorder, StreamReplayer
+ * sends them again into the other graph, at the original timing or as fast as
+ * the graph can take them.
+ *
+ * edge_record [file] [speed]
+ *
+ * A source sends 20 bursts of frames 20ms apart, they are recorded, then the
+ * file is replayed twice: with the original timing and with 'speed' (0 - as fast
+ * as possible). The device checks the content of each replayed frame.
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "stream_record.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t frame_len = 512;
+const long n_bursts = 20;
+const long burst = 50;
+
+atomic<long> received{0}, bad{0};
+
+bool dev_proc(shared_ptr<RealSignalPkt>&& msg){
+    if(msg->cmd != MSG_CMD::NONE) return true;
+    if(msg->data.size() != frame_len || msg->data[0] != received) bad++;
+    received++;
+    return true;
+}
+
+void record(const string& file){
+    auto rec = NodeFactory::create<StreamRecorder<RealSignalPkt>>(file);
+
+    long k = 0;
+    for(long b = 0; b < n_bursts; b++){
+        for(long i = 0; i < burst; i++, k++){
+            auto msg = make_shared<RealSignalPkt>();
+            msg->data.assign(frame_len, 0.0);
+            msg->data[0] = k;
+            rec->put(move(msg), 0, QUEUE_POLICY::WAIT);
+        }
+        this_thread::sleep_for(milliseconds(20));
+    }
+
+    rec->wait_drained();
+    cout << "recorded " << rec->recorded() << " frames into " << file << endl;
+}
+
+void replay(const string& file, double speed){
+    received = 0;
+    bad = 0;
+
+    auto dev = NodeFactory::create<BaseNode<RealSignalPkt>>(dev_proc, "Device");
+    auto t0 = steady_clock::now();
+    auto rp = NodeFactory::create<StreamReplayer<RealSignalPkt>>(file, speed);
+    rp->set_target(dev);
+
+    long n = n_bursts*burst;
+    while(received < n && steady_clock::now() - t0 < seconds(5))
+        this_thread::sleep_for(milliseconds(1));
+
+    cout << "speed " << speed << ": " << received << " frames, " << bad << " bad, "
+         << duration<double, milli>(steady_clock::now() - t0).count() << " ms" << endl;
+    rp->stop();
+    dev->stop();
+}
+
+int main(int argc, char** argv){
+    string file = argc > 1 ? argv[1] : "edge_record.dpf";
+    double speed = argc > 2 ? atof(argv[2]) : 0.0;
+
+    record(file);
+    replay(file, 1.0);
+    replay(file, speed);
+    return 0;
+}
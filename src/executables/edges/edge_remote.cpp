@@ -0,0 +1,148 @@
+/*
+ * Two graphs on two hosts connected by a network edge (see
+ * sources/remote_edge.hpp). The sender graph ends with RemoteSink, the
+ * receiver graph starts with RemoteSource.
+ *
+ * edge_remote recv tcp|udp 0.0.0.0:5000 [frames]      - the receiver host;
+ * edge_remote send tcp|udp 192.168.1.50:5000 [frames] - the sender host;
+ * edge_remote tcp|udp [frames]                         - both graphs in this process,
+ *                                                        connected through the loopback.
+ *
+ * Each frame carries it's number, in the middle of the stream the sender sends
+ * a USER command with a registered command data type, so it is delivered to
+ * the receiver graph too. The receiver prints how many frames were received
+ * in order, over UDP some of them can be lost.
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "remote_edge.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t frame_len = 256;
+
+/*
+ * The command data is sent to the other host only if it's type is registered
+ * in CmdDataRegistry, with the functions that write and read it (see serialization.h).
+ */
+struct GainCmd : public ICloneable{
+    GainCmd(double gain) : gain{gain} {}
+
+    virtual tPtrCloneable clone() const {
+        return make_shared<GainCmd>(gain);
+    }
+
+    virtual void apply(CommandNode*) const {}
+
+    void write(vector<char>& out) const {
+        out.insert(out.end(), (const char*)&gain, (const char*)&gain + sizeof(gain));
+    }
+
+    static shared_ptr<GainCmd> read(const char* data, size_t bytes){
+        if(bytes != sizeof(double)) return nullptr;
+        double gain;
+        memcpy(&gain, data, sizeof(gain));
+        return make_shared<GainCmd>(gain);
+    }
+
+    double gain;
+};
+
+atomic<long> received{0}, in_order{0}, commands{0};
+atomic<long> last{-1};
+
+bool dev_proc(shared_ptr<RealSignalPkt>&& msg){
+    if(msg->cmd == MSG_CMD::USER){
+        auto cmd = dynamic_pointer_cast<const GainCmd>(msg->user_data);
+        if(cmd) cout << "received the gain command: " << cmd->gain << endl;
+        commands++;
+        return true;
+    }
+
+    long k = msg->data.size() == frame_len ? (long)msg->data[0] : -1;
+    if(k > last) in_order++;
+    if(k >= 0) last = k;
+    received++;
+    return true;
+}
+
+shared_ptr<RemoteSource<RealSignalPkt>> make_receiver(const string& address, REMOTE_PROTOCOL proto){
+    auto src = NodeFactory::create<RemoteSource<RealSignalPkt>>(address, proto, QUEUE_POLICY::WAIT);
+    auto dev = NodeFactory::create<BaseNode<RealSignalPkt>>(dev_proc, "Device");
+    src->set_target(dev);
+    return src;
+}
+
+void send(const string& address, REMOTE_PROTOCOL proto, long n){
+    // the sink sends the bursts of frames, the queue shell hold a burst
+    NodeAttr attr;
+    attr.max_msgs = 1024;
+    auto sink = NodeFactory::create_with<RemoteSink<RealSignalPkt>>(attr, address, proto);
+
+    // the connection is established with the first message
+    sink->put(MSG_CMD::USER, 0, QUEUE_POLICY::WAIT, make_shared<GainCmd>(1.0));
+    this_thread::sleep_for(milliseconds(100));
+
+    auto t0 = steady_clock::now();
+    for(long k = 0; k < n; k++){
+        if(k == n/2) sink->put(MSG_CMD::USER, 0, QUEUE_POLICY::WAIT, make_shared<GainCmd>(2.5));
+
+        auto msg = make_shared<RealSignalPkt>();
+        msg->data.assign(frame_len, 0.0);
+        msg->data[0] = k;
+        sink->put(move(msg), 0, QUEUE_POLICY::WAIT);
+    }
+    sink->wait_drained();
+    cout << "sent " << n << " frames in " << duration<double, milli>(steady_clock::now() - t0).count()
+         << " ms" << endl;
+}
+
+void report(long n){
+    auto t0 = steady_clock::now();
+    while(received < n && steady_clock::now() - t0 < seconds(3))
+        this_thread::sleep_for(milliseconds(10));
+    cout << "received " << received << " of " << n << " frames, " << in_order << " in order, "
+         << commands << " commands" << endl;
+}
+
+REMOTE_PROTOCOL protocol(const string& str){
+    return str == "udp" ? REMOTE_PROTOCOL::UDP : REMOTE_PROTOCOL::TCP;
+}
+
+int main(int argc, char** argv){
+    CmdDataRegistry::reg<GainCmd>("gain");
+
+    string mode = argc > 1 ? argv[1] : "tcp";
+    if((mode == "send" || mode == "recv") && argc < 4){
+        cerr << "usage: " << argv[0] << " send|recv tcp|udp ip:port [frames]" << endl;
+        return 1;
+    }
+
+    if(mode == "recv"){
+        long n = argc > 4 ? atol(argv[4]) : 10000;
+        make_receiver(argv[3], protocol(argv[2]));
+
+        // the sender may be not started yet
+        while(received == 0) this_thread::sleep_for(milliseconds(10));
+        report(n);
+        return 0;
+    }
+
+    if(mode == "send"){
+        send(argv[3], protocol(argv[2]), argc > 4 ? atol(argv[4]) : 10000);
+        return 0;
+    }
+
+    long n = argc > 2 ? atol(argv[2]) : 10000;
+    make_receiver("127.0.0.1:5000", protocol(mode));
+    send("127.0.0.1:5000", protocol(mode), n);
+    report(n);
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Two graphs in two processes connected by a shared memory edge (see
+ * sources/shm_edge.hpp). The sender graph ends with ShmSink, the receiver
+ * graph starts with ShmSource, both use the same segment name.
+ *
+ * edge_shm send [frames]  - the sender process;
+ * edge_shm recv [frames]  - the receiver process, it can be started first;
+ * edge_shm [frames]       - both sides, the receiver is forked.
+ *
+ * Each frame carries it's number, the receiver checks that the frames arrive
+ * in order and complete and prints the throughput.
+ */
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shm_edge.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+const char* shm_name = "/dpf_edge_shm";
+const size_t frame_len = 1024;
+
+int send(long n){
+    auto sink = NodeFactory::create<ShmSink<RealSignalPkt>>(shm_name, 64, frame_len*sizeof(double),
+                                                             QUEUE_POLICY::WAIT);
+    auto t0 = steady_clock::now();
+    for(long k = 0; k < n; k++){
+        auto msg = make_shared<RealSignalPkt>();
+        msg->data.assign(frame_len, 0.0);
+        msg->data[0] = k;
+        sink->put(move(msg), 0, QUEUE_POLICY::WAIT);
+    }
+
+    // the frames in the queue are written before the sink stops
+    NodeFactory::stop_all(true);
+    cout << "sent " << n << " frames in " << duration<double, milli>(steady_clock::now() - t0).count()
+         << " ms, dropped " << sink->get_stats().drops[(size_t)DROP_REASON::QUEUE_FULL] << endl;
+    return 0;
+}
+
+int recv(long n){
+    atomic<long> received{0}, bad{0};
+    auto src = NodeFactory::create<ShmSource<RealSignalPkt>>(shm_name, QUEUE_POLICY::WAIT);
+    auto dev = NodeFactory::create<BaseNode<RealSignalPkt>>([&](shared_ptr<RealSignalPkt>&& msg){
+        if(msg->data.size() != frame_len || msg->data[0] != received) bad++;
+        received++;
+        return true;
+    }, "Device");
+    src->set_target(dev);
+
+    // the sender may be not started yet
+    auto t0 = steady_clock::now();
+    while(received < n && steady_clock::now() - t0 < seconds(10))
+        this_thread::sleep_for(milliseconds(1));
+
+    cout << "received " << received << " frames, " << bad << " bad" << endl;
+    return received == n && bad == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv){
+    string mode = argc > 1 ? argv[1] : "";
+    if(mode == "send") return send(argc > 2 ? atol(argv[2]) : 10000);
+    if(mode == "recv") return recv(argc > 2 ? atol(argv[2]) : 10000);
+
+    long n = argc > 1 ? atol(argv[1]) : 10000;
+    pid_t pid = fork();
+    if(pid == 0) _exit(recv(n));
+
+    int ret_val = send(n);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ret_val || !WIFEXITED(status) || WEXITSTATUS(status);
+}
@@ -0,0 +1,96 @@
+/*
+ * When one stage of the chain is slower than the source, the frames are dropped
+ * (or the whole chain is stalled with the WAIT policy) no matter how many cores
+ * are idle. ParallelFilter (see core/parallel_filter.hpp) runs K replicas of the
+ * slow filter in parallel and forwards the results strictly in the input order,
+ * so the downstream nodes see exactly the same sequence as from a single filter.
+ *
+ * In this example the slow filter is emulated by a busy loop of about 2ms per
+ * frame. The same frames are sent through the single filter and through the
+ * parallel one with K = 1, 2 and 4, the device checks that the frames arrive in
+ * order and prints the throughput. In the middle of the run a USER command
+ * changes the number of replicas on the fly.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+
+#include "base_filter.hpp"
+#include "parallel_filter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+using tMsg = GenericDataPkt<long>;
+
+/*
+ * The slow filter. It has to be a class with a default constructor (or a stage
+ * factory has to be passed to the ParallelFilter), because each replica owns
+ * it's own copy of the filter and of it's internal state.
+ */
+class SlowFilter : public BaseFilter<tMsg, tMsg>{
+protected:
+    friend class NodeFactory;
+    SlowFilter() : BaseFilter<tMsg, tMsg>(nullptr, QUEUE_POLICY::WAIT, "SlowFilter") {}
+
+    virtual tPtrOut internal_filter(tPtrIn&& msg){
+        auto until = steady_clock::now() + milliseconds(2);
+        while(steady_clock::now() < until);
+        return msg;
+    }
+};
+
+using tParallel = ParallelFilter<SlowFilter>;
+
+atomic<long> received{0};
+atomic<long> out_of_order{0};
+
+bool dev_proc(shared_ptr<tMsg>&& msg){
+    if(msg->cmd != MSG_CMD::NONE) return true;
+    if(msg->val != received) out_of_order++;
+    received++;
+    return true;
+}
+
+// send n frames and wait for all of them, returns frames per second
+template<typename tNode>
+double run(shared_ptr<tNode> node, long n, bool resize = false){
+    received = 0;
+    auto t0 = steady_clock::now();
+    for(long k = 0; k < n; k++){
+        // the command is applied after all frames sent before it
+        if(resize && k == n/2)
+            node->put(MSG_CMD::USER, 0, QUEUE_POLICY::WAIT, make_shared<tParallel::tUsrCmdReplicas>(1));
+
+        auto msg = make_shared<tMsg>();
+        msg->val = k;
+        node->put(move(msg), 0, QUEUE_POLICY::WAIT);
+    }
+    while(received < n) this_thread::sleep_for(milliseconds(1));
+    return n / duration<double>(steady_clock::now() - t0).count();
+}
+
+int main(){
+    const long n = 500;
+
+    auto dev = NodeFactory::create<BaseNode<tMsg>>(dev_proc, "Device");
+
+    auto single = NodeFactory::create<SlowFilter>();
+    single->set_target(dev);
+    cout << "single filter: " << run(single, n) << " frames/s" << endl;
+
+    auto parallel = NodeFactory::create<tParallel>(1, QUEUE_POLICY::WAIT);
+    parallel->set_target(dev);
+    for(size_t k : {1, 2, 4}){
+        parallel->set_replicas(k);
+        cout << "parallel, K = " << k << ": " << run(parallel, n) << " frames/s" << endl;
+    }
+
+    parallel->set_replicas(4);
+    cout << "parallel, K = 4 -> 1 by command: " << run(parallel, n, true) << " frames/s, K = "
+         << parallel->get_replicas() << endl;
+
+    cout << "frames out of order: " << out_of_order << endl;
+    return 0;
+}
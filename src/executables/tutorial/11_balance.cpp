@@ -0,0 +1,89 @@
+/*
+ * BaseSplitter broadcasts each message to all of it's targets, it is used when
+ * the same frame is processed in different ways. When the frames (or channels)
+ * are independent and the processing is the same, BalancingSplitter (see
+ * core/balancing_splitter.hpp) sends each frame to one of several identical
+ * worker chains:
+ *
+ * ROUND_ROBIN - the workers are used in turn;
+ * LEAST_LOADED - the worker with the shortest input queue is used, so a slow
+ * worker receives less frames;
+ * HASH_BY_KEY - all frames with the same key go to the same worker, here the
+ * frames of one channel are always processed by one worker, in order.
+ *
+ * In this example the second worker is three times slower than the others.
+ * The same frames are sent with each strategy and the device prints how many
+ * frames each worker has processed.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "base_filter.hpp"
+#include "balancing_splitter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// the value is the channel number of the frame
+using tMsg = GenericDataPkt<long>;
+using tWorker = BaseFilter<tMsg, tMsg>;
+using tBalancer = BalancingSplitter<tMsg>;
+
+const int n_workers = 3;
+const int n_channels = 6;
+
+atomic<long> processed[n_workers];
+atomic<long> received{0};
+
+// the worker 'idx' tags the frame with it's number
+shared_ptr<tWorker> make_worker(int idx, shared_ptr<BaseNode<tMsg>> dev){
+    auto delay = microseconds(idx == 1 ? 600 : 200);
+    auto worker = NodeFactory::create<tWorker>([idx, delay](shared_ptr<tMsg>&& msg){
+        this_thread::sleep_for(delay);
+        processed[idx]++;
+        return move(msg);
+    }, QUEUE_POLICY::WAIT, "Worker " + to_string(idx));
+    worker->set_target(dev);
+    return worker;
+}
+
+void run(tBalancer::STRATEGY strategy, const string& name, shared_ptr<BaseNode<tMsg>> dev){
+    tBalancer::tKeyFunc key = [](tMsg& msg){return (size_t)msg.val;};
+    auto balancer = NodeFactory::create<tBalancer>(strategy, QUEUE_POLICY::WAIT, "Balancer", key);
+
+    vector<shared_ptr<tWorker>> workers;
+    for(int i = 0; i < n_workers; i++){
+        processed[i] = 0;
+        workers.push_back(make_worker(i, dev));
+        balancer->add_target(workers.back());
+    }
+
+    const long n = 600;
+    received = 0;
+    for(long k = 0; k < n; k++){
+        auto msg = make_shared<tMsg>();
+        msg->val = k % n_channels;
+        balancer->put(move(msg), 0, QUEUE_POLICY::WAIT);
+    }
+    while(received < n) this_thread::sleep_for(milliseconds(1));
+
+    cout << name << ":";
+    for(int i = 0; i < n_workers; i++) cout << " " << processed[i];
+    cout << endl;
+}
+
+int main(){
+    auto dev = NodeFactory::create<BaseNode<tMsg>>([](shared_ptr<tMsg>&&){
+        received++;
+        return true;
+    }, "Device");
+
+    cout << "frames processed by the workers (the second one is slow)" << endl;
+    run(tBalancer::ROUND_ROBIN, "round robin", dev);
+    run(tBalancer::LEAST_LOADED, "least loaded", dev);
+    run(tBalancer::HASH_BY_KEY, "hash by channel", dev);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * A chain of short filters pays a queue hop, a thread wakeup and an intermediate
+ * message for each stage. FusedFilter (see core/fused_filter.hpp) runs a linear
+ * chain of filters inside one node, the stages are called back to back and the
+ * attached data moves through them as between the separate nodes.
+ *
+ * In this example the spectrum of a sine is calculated by three stages:
+ * Gain -> DFT -> Power. The same frames are sent through the chain of separate
+ * nodes and through the fused one, the device prints the throughput, the peak
+ * bin and it's power. In the middle of the run a USER command changes the gain,
+ * it is applied to each stage of the fused chain, as to the separate nodes.
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#include "fused_filter.hpp"
+#include "dft_filter.hpp"
+#include "power_filter.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// multiply the signal by a gain, the gain is changed by the tUsrCmdGain command
+class GainFilter : public BaseFilter<RealSignalPkt, RealSignalPkt>{
+public:
+    struct tUsrCmdGain : public ICloneable{
+        tUsrCmdGain(double gain) : gain{gain} {}
+
+        virtual tPtrCloneable clone() const {
+            return make_shared<tUsrCmdGain>(gain);
+        }
+
+        // the fused node and each of it's stages receive the command, only the gain stage applies it
+        virtual void apply(CommandNode* ptr) const {
+            auto filter = dynamic_cast<GainFilter*>(ptr);
+            if(filter) filter->gain = gain;
+        }
+
+        double gain;
+    };
+
+protected:
+    friend class NodeFactory;
+    GainFilter(QUEUE_POLICY pol = QUEUE_POLICY::WAIT) : BaseFilter(nullptr, pol, "GainFilter") {}
+
+    virtual tPtrOut internal_filter(tPtrIn&& msg){
+        // the command is applied already, it is not sent to the next stages
+        if(msg->cmd != MSG_CMD::NONE) return nullptr;
+
+        make_writable(msg);
+        for(auto& v : msg->data) v *= gain;
+        return move(msg);
+    }
+
+private:
+    double gain = 1.0;
+};
+
+using tDFTFilter = DFTFilter<RealSignalPkt, ComplexSignalPkt>;
+using tPower = PowerFilter<ComplexSignalPkt, RealSignalPkt>;
+using tSpectrum = FusedFilter<GainFilter, tDFTFilter, tPower>;
+
+const size_t N = 1024;
+const size_t sine_bin = 100;
+
+atomic<long> received{0};
+size_t peak_bin = 0;
+double peak_pow = 0.0;
+
+bool dev_proc(shared_ptr<RealSignalPkt>&& msg){
+    if(msg->cmd != MSG_CMD::NONE) return true;
+
+    // the spectrum is symmetric, the first half is enough
+    peak_bin = 0;
+    for(size_t i = 1; i < msg->data.size()/2; i++)
+        if(msg->data[i] > msg->data[peak_bin]) peak_bin = i;
+    peak_pow = msg->data[peak_bin];
+    received++;
+    return true;
+}
+
+void print_peak(){
+    cout << "    peak bin " << peak_bin << ", power " << peak_pow << endl;
+}
+
+// send n frames and wait for all of them, the gain is changed in the middle, returns frames per second
+template<typename tNode>
+double run(shared_ptr<tNode> node, long n){
+    received = 0;
+    auto t0 = steady_clock::now();
+    for(long k = 0; k < n; k++){
+        if(k == n/2){
+            while(received < k) this_thread::sleep_for(microseconds(100));
+            print_peak();
+            node->put(MSG_CMD::USER, 0, QUEUE_POLICY::WAIT, make_shared<GainFilter::tUsrCmdGain>(2.0));
+        }
+
+        auto msg = make_shared<RealSignalPkt>();
+        msg->data.resize(N);
+        for(size_t t = 0; t < N; t++)
+            msg->data[t] = cos(2*M_PI*sine_bin*t/N);
+        node->put(move(msg), 0, QUEUE_POLICY::WAIT);
+    }
+    while(received < n) this_thread::sleep_for(milliseconds(1));
+    double fps = n / duration<double>(steady_clock::now() - t0).count();
+    print_peak();
+    return fps;
+}
+
+int main(){
+    const long n = 2000;
+
+    auto dev = NodeFactory::create<BaseNode<RealSignalPkt>>(dev_proc, "Device");
+
+    auto gain = NodeFactory::create<GainFilter>();
+    auto dft = NodeFactory::create<tDFTFilter>(QUEUE_POLICY::WAIT);
+    auto pow = NodeFactory::create<tPower>(tPower::POW, QUEUE_POLICY::WAIT);
+    gain->set_target(dft);
+    dft->set_target(pow);
+    pow->set_target(dev);
+    cout << "separate nodes, gain 1 -> 2:" << endl;
+    double fps = run(gain, n);
+    cout << "    " << fps << " frames/s" << endl;
+
+    // the stages are created explicitly to set the power mode
+    auto spectrum = NodeFactory::create<tSpectrum>(QUEUE_POLICY::WAIT, "Spectrum",
+                                                   make_shared<FilterStage<GainFilter>>(),
+                                                   make_shared<FilterStage<tDFTFilter>>(),
+                                                   make_shared<FilterStage<tPower>>(tPower::POW));
+    spectrum->set_target(dev);
+    cout << "fused node, gain 1 -> 2:" << endl;
+    fps = run(spectrum, n);
+    cout << "    " << fps << " frames/s" << endl;
+    return 0;
+}
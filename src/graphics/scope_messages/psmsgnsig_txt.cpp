@@ -72,3 +72,83 @@ PSMsgNSigTxt::get_data(string& dest) const{
     dest = ss.str();
 }
 
+
+size_t
+MsgSerializer<PSMsgNSigTxt>::size(const PSMsgNSigTxt& msg){
+    size_t bytes = 2*sizeof(uint64_t) + 2*sizeof(double) + sizeof(uint64_t);
+    if(msg.mat) bytes += msg.mat->size1*msg.mat->size2*sizeof(double);
+    for(auto& w : msg.with)
+        bytes += 2*sizeof(uint64_t) + MsgRecord::pad(w.second.size());
+    return bytes;
+}
+
+void
+MsgSerializer<PSMsgNSigTxt>::write(const PSMsgNSigTxt& msg, char* dst){
+    uint64_t head[2] = {msg.mat ? msg.mat->size1 : 0, msg.mat ? msg.mat->size2 : 0};
+    double x[2] = {msg.x_min, msg.x_max};
+    memcpy(dst, head, sizeof(head)); dst += sizeof(head);
+    memcpy(dst, x, sizeof(x)); dst += sizeof(x);
+
+    // the rows are written without the gsl_matrix stride
+    for(size_t i = 0; i < head[0]; i++){
+        memcpy(dst, gsl_matrix_const_ptr(msg.mat.get(), i, 0), head[1]*sizeof(double));
+        dst += head[1]*sizeof(double);
+    }
+
+    uint64_t n = msg.with.size();
+    memcpy(dst, &n, sizeof(n)); dst += sizeof(n);
+    for(auto& w : msg.with){
+        int64_t col = w.first;
+        uint64_t len = w.second.size();
+        memcpy(dst, &col, sizeof(col)); dst += sizeof(col);
+        memcpy(dst, &len, sizeof(len)); dst += sizeof(len);
+        memcpy(dst, w.second.data(), len);
+        memset(dst + len, 0, MsgRecord::pad(len) - len);
+        dst += MsgRecord::pad(len);
+    }
+}
+
+bool
+MsgSerializer<PSMsgNSigTxt>::read(const char* src, size_t bytes, uint16_t version, PSMsgNSigTxt& msg){
+    const char* end = src + bytes;
+    uint64_t head[2];
+    double x[2];
+    if(version != 1 || bytes < sizeof(head) + sizeof(x) + sizeof(uint64_t)) return false;
+    memcpy(head, src, sizeof(head)); src += sizeof(head);
+    memcpy(x, src, sizeof(x)); src += sizeof(x);
+
+    if(head[1] && head[0] > (size_t)(end - src)/sizeof(double)/head[1]) return false;
+    size_t row_bytes = head[1]*sizeof(double);
+
+    if(!head[0] || !head[1]){
+        msg.mat = nullptr;
+    }else{
+        // the matrix of a reused message is kept if it has the same size
+        if(!msg.mat || msg.mat->size1 != head[0] || msg.mat->size2 != head[1] || msg.mat.use_count() > 1)
+            msg.mat = std::shared_ptr<gsl_matrix>(gsl_matrix_alloc(head[0], head[1]),
+                                                  [] (gsl_matrix *p) {gsl_matrix_free(p);} );
+        for(size_t i = 0; i < head[0]; i++){
+            memcpy(gsl_matrix_ptr(msg.mat.get(), i, 0), src, row_bytes);
+            src += row_bytes;
+        }
+    }
+    msg.x_min = x[0];
+    msg.x_max = x[1];
+
+    uint64_t n;
+    if((size_t)(end - src) < sizeof(n)) return false;
+    memcpy(&n, src, sizeof(n)); src += sizeof(n);
+
+    msg.with.clear();
+    for(uint64_t i = 0; i < n; i++){
+        int64_t col;
+        uint64_t len;
+        if((size_t)(end - src) < sizeof(col) + sizeof(len)) return false;
+        memcpy(&col, src, sizeof(col)); src += sizeof(col);
+        memcpy(&len, src, sizeof(len)); src += sizeof(len);
+        if(len > (size_t)(end - src) || MsgRecord::pad(len) > (size_t)(end - src)) return false;
+        msg.with[(int)col] = std::string(src, len);
+        src += MsgRecord::pad(len);
+    }
+    return true;
+}
@@ -137,4 +137,20 @@ struct PSMsgNSigTxt : public PSIMsg{
     double x_min = 0.0, x_max = 0.0;
 };
 
+/*
+ * The record body (see serialization.h): rows, cols (uint64), x_min, x_max, the matrix
+ * rows one by one, so it can be read in place as a rows x cols array of doubles, and
+ * then the 'with' strings as [count (uint64)] and [col (int64)][length (uint64)][chars]
+ * each padded to 8 bytes.
+ */
+template<>
+struct MsgSerializer<PSMsgNSigTxt>{
+    static const char* name(){return "PSMsgNSigTxt";}
+    static uint16_t version(){return 1;}
+    static size_t size(const PSMsgNSigTxt& msg);
+    static void write(const PSMsgNSigTxt& msg, char* dst);
+    static bool read(const char* src, size_t bytes, uint16_t version, PSMsgNSigTxt& msg);
+    static const void* view(const PSMsgNSigTxt&){return nullptr;}
+};
+
 #endif //DISTPIPELINEFWK_PSMSGNSIG_TXT_H
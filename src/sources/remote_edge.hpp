@@ -0,0 +1,434 @@
+#ifndef DISTPIPELINEFWK_REMOTE_EDGE_HPP
+#define DISTPIPELINEFWK_REMOTE_EDGE_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "base_source.hpp"
+#include "msg_pool.hpp"
+#include "serialization.h"
+
+/*
+ * An edge between the graphs on different hosts: RemoteSink<T> is the last node
+ * of the sender graph, RemoteSource<T> is the first node of the receiver graph.
+ *
+ * Sender:
+ * auto net = NodeFactory::create<RemoteSink<RealSignalPkt>>("192.168.1.50:5000");
+ * filter->set_target(net);
+ *
+ * Receiver:
+ * auto net = NodeFactory::create<RemoteSource<RealSignalPkt>>("0.0.0.0:5000");
+ * net->set_target(fft);
+ *
+ * Each message is sent as a record (see serialization.h) with the serialized
+ * user_data. The UID and the command are kept, so the joins work across hosts and
+ * the USER commands reach the remote nodes. STOP is never forwarded: each graph is
+ * stopped by it's own process. The user_data is sent only if it's type is registered
+ * in CmdDataRegistry.
+ *
+ * The sink drains up to NodeAttr::batch_size messages at once (64 if it is not
+ * set) and sends them with one gather write, the payloads are not copied into a
+ * send buffer. Over TCP the sink connects (and reconnects) to the source, the
+ * messages sent while there is no connection are dropped. A connect attempt takes
+ * at most connect_timeout, so an unreachable source does not stall the sink. Over UDP several frames are
+ * packed into one datagram, a frame that does not fit into a datagram is dropped.
+ * The source closes the TCP connection on a record larger than max_record, as on
+ * a bad magic, so a corrupted stream can't make it allocate an arbitrary buffer.
+ *
+ * The record uses the host byte order, both hosts shell have the same one (it is
+ * checked by the magic number).
+ */
+
+enum class REMOTE_PROTOCOL{TCP, UDP};
+
+// "ip:port" into an address and a port, false if it can't be parsed
+inline bool parse_remote_address(const std::string& str, boost::asio::ip::address& ip, unsigned short& port){
+    auto pos = str.rfind(':');
+    if(pos == std::string::npos) return false;
+    try{
+        ip = boost::asio::ip::address::from_string(str.substr(0, pos));
+        port = boost::lexical_cast<unsigned short>(str.substr(pos + 1));
+    }catch(...){
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+class RemoteSink : public BaseNode<T>{
+public:
+    using tBase = BaseNode<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tTCP = boost::asio::ip::tcp;
+    using tUDP = boost::asio::ip::udp;
+
+protected:
+    friend class NodeFactory;
+    RemoteSink(std::string address, REMOTE_PROTOCOL proto = REMOTE_PROTOCOL::TCP,
+               std::string name = "RemoteSink", size_t max_datagram = 65000):
+            tBase(name), address{address}, proto{proto}, max_datagram{max_datagram},
+            tcp_sock{io_service}, udp_sock{io_service}, connect_timer{io_service} {
+        if(!parse_remote_address(address, ip, port))
+            std::cerr << name << ": can't parse " << address << ", example: 192.168.1.50:5000" << std::endl;
+    }
+
+public:
+    ~RemoteSink(){
+        // the node thread shell not use the sockets and buffers destroyed before ~BaseNode
+        this->stop();
+    }
+
+    // the attributes are set by NodeFactory after the constructor, so the default is applied here
+    void start_async(){
+        // the small messages are sent in bursts (see NodeAttr::batch_size)
+        if(this->attr.batch_size == 0) this->attr.batch_size = 64;
+        tBase::start_async();
+    }
+
+protected:
+
+    virtual bool process_usr_msg(tPtrIn&& msg){
+        single.clear();
+        single.push_back(move(msg));
+        bool ret = process_usr_batch(single);
+        single.clear();
+        return ret;
+    }
+
+    virtual bool process_usr_batch(std::vector<tPtrIn>& batch){
+        if(!connect()) return true;
+
+        // the gather lists shell not change until the write is done,
+        // the payload is sent in place if it is contiguous
+        records.resize(batch.size());
+        bufs.clear();
+
+        size_t datagram = 0;
+        for(size_t i = 0; i < batch.size(); i++){
+            auto& msg = *batch[i];
+            if(msg.cmd == MSG_CMD::STOP) continue;
+
+            auto& rec = records[i];
+            if(!gather_record(msg, rec)){
+                std::cerr << tBase::name << " warning: command data type is not registered, not sent" << std::endl;
+                continue;
+            }
+
+            size_t frame = rec.bytes;
+            if(proto == REMOTE_PROTOCOL::UDP){
+                if(frame > max_datagram){
+                    std::cerr << tBase::name << " warning: " << frame << " bytes frame does not fit a datagram" << std::endl;
+                    continue;
+                }
+                // a datagram is sent by one gather call, asio passes at most
+                // max_gather buffers to the system, the rest would be lost
+                if(rec.parts.size() > max_gather){
+                    std::cerr << tBase::name << " warning: the frame has too many parts for a datagram" << std::endl;
+                    continue;
+                }
+                if(datagram + frame > max_datagram || bufs.size() + rec.parts.size() > max_gather){
+                    send_datagram();
+                    datagram = 0;
+                }
+                datagram += frame;
+            }
+
+            for(auto& part : rec.parts)
+                bufs.push_back(boost::asio::buffer(part.data, part.bytes));
+        }
+
+        if(proto == REMOTE_PROTOCOL::UDP){
+            send_datagram();
+        }else if(!bufs.empty()){
+            boost::system::error_code ec;
+            boost::asio::write(tcp_sock, bufs, ec);
+            if(ec){
+                std::cerr << tBase::name << ": connection to " << address << " lost: " << ec.message() << std::endl;
+                tcp_sock.close(ec);
+            }
+        }
+        return true;
+    }
+
+private:
+    // TCP: connect if not connected, the attempts are at least 500ms apart
+    bool connect(){
+        if(port == 0) return false;
+        boost::system::error_code ec;
+
+        if(proto == REMOTE_PROTOCOL::UDP){
+            if(udp_sock.is_open()) return true;
+            udp_sock.open(ip.is_v4() ? tUDP::v4() : tUDP::v6(), ec);
+            return !ec;
+        }
+
+        if(tcp_sock.is_open()) return true;
+        auto now = std::chrono::steady_clock::now();
+        if(now < next_attempt) return false;
+        next_attempt = now + std::chrono::milliseconds(500);
+
+        // the node thread is blocked by the attempt no longer than connect_timeout
+        bool done = false;
+        tcp_sock.async_connect(tTCP::endpoint(ip, port), [this, &ec, &done](const boost::system::error_code& res){
+            ec = res;
+            done = true;
+            connect_timer.cancel();
+        });
+        connect_timer.expires_from_now(connect_timeout);
+        connect_timer.async_wait([this, &done](const boost::system::error_code&){
+            boost::system::error_code close_ec;
+            if(!done) tcp_sock.close(close_ec);
+        });
+        io_service.reset();
+        io_service.run();
+
+        if(ec){
+            if(!conn_warned)
+                std::cerr << tBase::name << ": can't connect to " << address << ": " << ec.message()
+                          << ", the messages are dropped until connected" << std::endl;
+            conn_warned = true;
+            tcp_sock.close(ec);
+            return false;
+        }
+        conn_warned = false;
+        tcp_sock.set_option(tTCP::no_delay(true), ec);
+        std::cout << tBase::name << ": connected to " << address << std::endl;
+        return true;
+    }
+
+    void send_datagram(){
+        if(bufs.empty()) return;
+        boost::system::error_code ec;
+        udp_sock.send_to(bufs, tUDP::endpoint(ip, port), 0, ec);
+        if(ec) std::cerr << tBase::name << " warning: send_to failed: " << ec.message() << std::endl;
+        bufs.clear();
+    }
+
+private:
+    std::string address;
+    REMOTE_PROTOCOL proto;
+    size_t max_datagram;
+    boost::asio::ip::address ip;
+    unsigned short port = 0;
+
+    boost::asio::io_service io_service;
+    tTCP::socket tcp_sock;
+    tUDP::socket udp_sock;
+    boost::asio::steady_timer connect_timer;
+    std::chrono::steady_clock::time_point next_attempt;
+    bool conn_warned = false;
+    std::chrono::milliseconds connect_timeout{200};
+
+    // the send state, reused between the batches
+    std::vector<tPtrIn> single;
+    std::vector<MsgGather> records;
+    std::vector<boost::asio::const_buffer> bufs;
+
+    // boost::asio::detail::max_iov_len on the most systems
+    static constexpr size_t max_gather = 64;
+};
+
+template<typename T>
+class RemoteSource : public BaseSource<T>{
+public:
+    using tBase = BaseSource<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrOut = typename tBase::tPtrOut;
+    using tTCP = boost::asio::ip::tcp;
+    using tUDP = boost::asio::ip::udp;
+    using tErrCode = boost::system::error_code;
+
+protected:
+    friend class NodeFactory;
+
+    /*
+     * 'listen' is the local "ip:port". Over TCP one sender is served at a time,
+     * the next connection is accepted when the current one is closed. A TCP
+     * record larger than 'max_record' bytes closes the connection.
+     */
+    RemoteSource(std::string listen, REMOTE_PROTOCOL proto = REMOTE_PROTOCOL::TCP,
+                 QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "RemoteSource",
+                 size_t max_record = 1 << 26):
+            tBase(nullptr, pol, name), listen{listen}, proto{proto}, max_record{max_record} {}
+
+public:
+    ~RemoteSource(){
+        // the asio thread shell not use the sockets and the buffer destroyed before ~BaseNode
+        this->stop();
+    }
+
+protected:
+
+    virtual void main_loop(){
+        boost::asio::ip::address ip;
+        unsigned short port;
+        if(!parse_remote_address(listen, ip, port)){
+            std::cerr << tBase::name << ": can't parse " << listen << ", example: 0.0.0.0:5000" << std::endl;
+            wait_stop();
+            return;
+        }
+
+        boost::asio::io_service io_service;
+        try{
+            if(proto == REMOTE_PROTOCOL::TCP){
+                acceptor.reset(new tTCP::acceptor(io_service, tTCP::endpoint(ip, port)));
+                sock.reset(new tTCP::socket(io_service));
+                async_accept();
+            }else{
+                udp_sock.reset(new tUDP::socket(io_service, tUDP::endpoint(ip, port)));
+                // the bursts of datagrams are lost when the socket buffer is small
+                tErrCode ec;
+                udp_sock->set_option(boost::asio::socket_base::receive_buffer_size(1 << 22), ec);
+                body.resize(1 << 16);
+                async_receive();
+            }
+            std::cout << tBase::name << ": listening to " << listen << std::endl;
+        }catch(std::exception& e){
+            std::cerr << tBase::name << ": can't listen to " << listen << ": " << e.what() << std::endl;
+            wait_stop();
+            return;
+        }
+
+        // the messages are received and forwarded by the asio thread
+        std::thread t([this, &io_service]{ run(io_service); });
+        wait_stop();
+
+        io_service.stop();
+        t.join();
+        sock.reset();
+        acceptor.reset();
+        udp_sock.reset();
+    }
+
+private:
+    /*
+     * A handler that throws (a failed allocation, an exception of the next node)
+     * ends io_service.run, the asio thread shell not die with it: the session is
+     * restarted and the service is run again until it is stopped.
+     */
+    void run(boost::asio::io_service& io_service){
+        while(1){
+            try{
+                io_service.run();
+                return;
+            }catch(std::exception& e){
+                std::cerr << tBase::name << ": " << e.what() << ", the session is restarted" << std::endl;
+            }
+            if(proto == REMOTE_PROTOCOL::TCP) reconnect();
+            else async_receive();
+        }
+    }
+
+    void wait_stop(){
+        while(1){
+            tPtrIn curr_in = this->pull_msg(true);
+            if(curr_in && curr_in->cmd == MSG_CMD::STOP) break;
+        }
+    }
+
+    //*************** TCP ***************
+
+    void async_accept(){
+        acceptor->async_accept(*sock, [this](const tErrCode& ec){
+            if(ec) return;
+            tErrCode opt_ec;
+            sock->set_option(tTCP::no_delay(true), opt_ec);
+            async_read_header();
+        });
+    }
+
+    void reconnect(){
+        tErrCode ec;
+        sock->close(ec);
+        async_accept();
+    }
+
+    // the record header and then the rest of the record into the same buffer
+    void async_read_header(){
+        body.resize(sizeof(MsgRecord));
+        boost::asio::async_read(*sock, boost::asio::buffer(body),
+                                [this](const tErrCode& ec, size_t){
+            if(ec) return reconnect();
+            MsgRecord h;
+            memcpy(&h, body.data(), sizeof(h));
+            if(h.tag != MsgRecord::magic || h.format != MsgRecord::format_version){
+                std::cerr << tBase::name << ": bad frame, the connection is closed" << std::endl;
+                return reconnect();
+            }
+            if(h.body_bytes > max_record || h.cmd_bytes > max_record || h.record_bytes() > max_record){
+                std::cerr << tBase::name << ": " << h.record_bytes() << " bytes record is larger than "
+                          << max_record << ", the connection is closed" << std::endl;
+                return reconnect();
+            }
+            body.resize(h.record_bytes());
+            boost::asio::async_read(*sock, boost::asio::buffer(body.data() + sizeof(h), body.size() - sizeof(h)),
+                                    [this](const tErrCode& ec, size_t){
+                if(ec) return reconnect();
+                deliver(MsgRecordView(body.data(), body.size()));
+                async_read_header();
+            });
+        });
+    }
+
+    //*************** UDP ***************
+
+    void async_receive(){
+        udp_sock->async_receive_from(boost::asio::buffer(body), sender,
+                                     [this](const tErrCode& ec, size_t bytes){
+            if(ec == boost::asio::error::operation_aborted) return;
+            if(!ec){
+                // a datagram carries one or more complete records
+                size_t pos = 0;
+                while(pos < bytes){
+                    MsgRecordView rec(body.data() + pos, bytes - pos);
+                    if(!rec.valid()){
+                        std::cerr << tBase::name << " warning: malformed datagram" << std::endl;
+                        break;
+                    }
+                    deliver(rec);
+                    pos += rec.size();
+                }
+            }
+            async_receive();
+        });
+    }
+
+    // decode and forward one message
+    void deliver(const MsgRecordView& rec){
+        if(!this->next) return;
+
+        if(!rec.valid() || (MSG_CMD)rec.header().cmd == MSG_CMD::STOP){
+            std::cerr << tBase::name << " warning: bad frame" << std::endl;
+            return;
+        }
+
+        auto out = MsgPool<T>::acquire();
+        if(!deserialize(rec, *out)){
+            std::cerr << tBase::name << " warning: malformed payload or unknown command data, "
+                      << "the message is dropped" << std::endl;
+            return;
+        }
+        this->next->put(move(out), this->uid, this->pol);
+    }
+
+private:
+    std::string listen;
+    REMOTE_PROTOCOL proto;
+    size_t max_record;
+
+    // the asio objects live while the main_loop is running
+    std::unique_ptr<tTCP::acceptor> acceptor;
+    std::unique_ptr<tTCP::socket> sock;
+    std::unique_ptr<tUDP::socket> udp_sock;
+    tUDP::endpoint sender;
+
+    std::vector<char> body;
+};
+
+#endif //DISTPIPELINEFWK_REMOTE_EDGE_HPP
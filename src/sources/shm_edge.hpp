@@ -0,0 +1,421 @@
+#ifndef DISTPIPELINEFWK_SHM_EDGE_HPP
+#define DISTPIPELINEFWK_SHM_EDGE_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "base_source.hpp"
+#include "msg_pool.hpp"
+#include "serialization.h"
+
+/*
+ * An edge between two processes: ShmSink<T> is the last node of the sender graph,
+ * ShmSource<T> is the first node of the receiver graph, the messages are passed
+ * through a ring in a POSIX shared memory segment. So the acquisition and the
+ * heavy DSP can live in the different processes, a crash of one of them does not
+ * bring down the other one and they can be built with different flags.
+ *
+ * Sender:
+ * auto shm = NodeFactory::create<ShmSink<RealSignalPkt>>("/dpf_frames");
+ * filter->set_target(shm);
+ *
+ * Receiver:
+ * auto shm = NodeFactory::create<ShmSource<RealSignalPkt>>("/dpf_frames");
+ * shm->set_target(fft);
+ *
+ * The ring has a single writer and a single reader. Each slot holds one message
+ * record (see serialization.h), the payload is copied by MsgSerializer<T> straight
+ * into the ring slot and from the slot into a message taken from the MsgPool, there
+ * are no intermediate buffers. The message UID is kept, the commands and the attached
+ * data are not transferred: STOP of one process is not the STOP of the other one.
+ *
+ * The sink creates the segment (a stale one left by a crashed sink is replaced),
+ * the source waits until it appears and reattaches when the sink is restarted.
+ *
+ * An idle side does not poll: after a short spin the reader (or the writer of a
+ * full ring with the WAIT policy) sleeps on a futex in the ring header and the
+ * other side wakes it, the system call is made only when somebody sleeps. An
+ * idle source wakes up each 10ms to check the STOP command and each 100ms to
+ * check that the writer is alive. Where there is no futex (not Linux) the
+ * sleeping side polls the ring each millisecond.
+ */
+
+/*
+ * The shared memory segment: a header followed by n_slots fixed size slots, each
+ * slot is 64 bytes aligned. The position counters are never wrapped, the slot is
+ * position % n_slots.
+ */
+class ShmRing{
+public:
+    static constexpr uint32_t magic = 0x44504652; // "DPFR"
+    static constexpr uint32_t version = 4;
+    static constexpr size_t align = 64;
+
+    struct Header{
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint64_t n_slots;
+        uint64_t slot_bytes;
+        std::atomic<uint32_t> closed;
+
+        /*
+         * The writer and the reader positions live in separate cache lines. Each
+         * side bumps it's futex word when the other side is sleeping on it:
+         * data_seq when a frame is written, space_seq when a slot is freed.
+         */
+        alignas(64) std::atomic<uint64_t> head;
+        std::atomic<uint32_t> data_seq;
+        std::atomic<uint32_t> writer_sleeps;
+        alignas(64) std::atomic<uint64_t> tail;
+        std::atomic<uint32_t> space_seq;
+        std::atomic<uint32_t> reader_sleeps;
+    };
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+                  "the shared memory ring needs address-free atomics");
+
+    ~ShmRing(){
+        detach();
+    }
+
+    // the writer side, 'slot_bytes' is the largest record
+    bool create(const std::string& name, size_t n_slots, size_t slot_bytes){
+        detach();
+        shm_unlink(name.c_str());
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0) return false;
+
+        size_t stride = slot_stride(slot_bytes);
+        size_t len = header_size() + n_slots*stride;
+        if(ftruncate(fd, (off_t)len) != 0 || !map(fd, len)){
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        close(fd);
+
+        // the memory is zeroed by ftruncate, the magic is published last
+        hdr->version = version;
+        hdr->n_slots = n_slots;
+        hdr->slot_bytes = slot_bytes;
+        hdr->magic.store(magic, std::memory_order_release);
+        this->name = name;
+        owner = true;
+        return true;
+    }
+
+    // the reader side, fails if the segment does not exist or is not initialized yet
+    bool open(const std::string& name){
+        detach();
+
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if(fd < 0) return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < header_size() || !map(fd, (size_t)st.st_size)){
+            close(fd);
+            return false;
+        }
+        close(fd);
+        ino = st.st_ino;
+
+        if(hdr->magic.load(std::memory_order_acquire) != magic || hdr->version != version ||
+           len < header_size() + hdr->n_slots*slot_stride(hdr->slot_bytes)){
+            detach();
+            return false;
+        }
+        this->name = name;
+        return true;
+    }
+
+    // the owner marks the ring closed and removes the name, the reader just unmaps it
+    void detach(){
+        if(!hdr) return;
+        if(owner){
+            hdr->closed.store(1, std::memory_order_release);
+            notify(hdr->reader_sleeps, hdr->data_seq);
+            shm_unlink(name.c_str());
+        }
+        munmap(base, len);
+        base = nullptr;
+        hdr = nullptr;
+        owner = false;
+    }
+
+    bool attached() const {return hdr != nullptr;}
+
+    // the writer has gone, or the name refers to a new segment of the restarted writer
+    bool stale() const {
+        if(hdr->closed.load(std::memory_order_acquire)) return true;
+        int fd = shm_open(name.c_str(), O_RDONLY, 0600);
+        if(fd < 0) return true;
+        struct stat st;
+        bool moved = fstat(fd, &st) != 0 || st.st_ino != ino;
+        close(fd);
+        return moved;
+    }
+
+    size_t slot_bytes() const {return hdr->slot_bytes;}
+
+    // writer: the slot to fill or null if the ring is full
+    char* begin_write(){
+        auto head = hdr->head.load(std::memory_order_relaxed);
+        if(head - hdr->tail.load(std::memory_order_acquire) >= hdr->n_slots) return nullptr;
+        return slot(head);
+    }
+
+    void end_write(){
+        hdr->head.store(hdr->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        notify(hdr->reader_sleeps, hdr->data_seq);
+    }
+
+    // writer: sleep until a slot is freed, but not longer than 'timeout'
+    void wait_writable(std::chrono::microseconds timeout){
+        auto seq = hdr->space_seq.load(std::memory_order_acquire);
+        hdr->writer_sleeps.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!begin_write()) sleep_on(hdr->space_seq, seq, timeout);
+        hdr->writer_sleeps.store(0, std::memory_order_relaxed);
+    }
+
+    // reader: the next filled slot or null if the ring is empty
+    const char* begin_read(){
+        auto tail = hdr->tail.load(std::memory_order_relaxed);
+        if(tail == hdr->head.load(std::memory_order_acquire)) return nullptr;
+        return slot(tail);
+    }
+
+    void end_read(){
+        hdr->tail.store(hdr->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        notify(hdr->writer_sleeps, hdr->space_seq);
+    }
+
+    // reader: sleep until a frame is written or the writer has gone, but not longer than 'timeout'
+    void wait_readable(std::chrono::microseconds timeout){
+        auto seq = hdr->data_seq.load(std::memory_order_acquire);
+        hdr->reader_sleeps.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!begin_read() && !hdr->closed.load(std::memory_order_acquire))
+            sleep_on(hdr->data_seq, seq, timeout);
+        hdr->reader_sleeps.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static size_t header_size(){
+        return (sizeof(Header) + align - 1)/align*align;
+    }
+
+    static size_t slot_stride(size_t slot_bytes){
+        return (slot_bytes + align - 1)/align*align;
+    }
+
+    bool map(int fd, size_t len){
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) return false;
+        base = static_cast<char*>(p);
+        hdr = reinterpret_cast<Header*>(base);
+        this->len = len;
+        return true;
+    }
+
+    char* slot(uint64_t pos){
+        return base + header_size() + (pos % hdr->n_slots)*slot_stride(hdr->slot_bytes);
+    }
+
+    /*
+     * The sleeping side sets it's flag before it checks the ring, the other side
+     * checks the flag after it has moved it's position, so one of them always
+     * sees the other one (the fences), and the wake is a system call only when
+     * the other side really sleeps. A wake between the check and the sleep changes
+     * the word, so the futex returns at once.
+     */
+    static void notify(std::atomic<uint32_t>& sleeps, std::atomic<uint32_t>& seq){
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!sleeps.load(std::memory_order_relaxed)) return;
+        seq.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+        // not FUTEX_PRIVATE_FLAG, the word is shared between the processes
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    static void sleep_on(std::atomic<uint32_t>& seq, uint32_t val, std::chrono::microseconds timeout){
+#ifdef __linux__
+        struct timespec ts;
+        ts.tv_sec = timeout.count()/1000000;
+        ts.tv_nsec = (timeout.count()%1000000)*1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAIT, val, &ts, nullptr, 0);
+#else
+        if(seq.load(std::memory_order_acquire) == val)
+            std::this_thread::sleep_for(std::min(timeout, std::chrono::microseconds(1000)));
+#endif
+    }
+
+private:
+    std::string name;
+    char* base = nullptr;
+    Header* hdr = nullptr;
+    size_t len = 0;
+    ino_t ino = 0;
+    bool owner = false;
+};
+
+template<typename T>
+class ShmSink : public BaseNode<T>{
+public:
+    using tBase = BaseNode<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+
+protected:
+    friend class NodeFactory;
+
+    /*
+     * 'n_slots' frames of at most 'slot_bytes' payload can be in the ring. When
+     * the ring is full the frame is dropped (DROP) or the node waits for the
+     * reader (WAIT), but not longer than 'wait_timeout', so a dead reader does
+     * not block the sender graph.
+     */
+    ShmSink(std::string shm_name, size_t n_slots = 64, size_t slot_bytes = 1 << 20,
+            QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "ShmSink",
+            std::chrono::milliseconds wait_timeout = std::chrono::milliseconds(1000)):
+            tBase(name), pol{pol}, wait_timeout{wait_timeout} {
+        if(!ring.create(shm_name, n_slots ? n_slots : 1, sizeof(MsgRecord) + slot_bytes))
+            std::cerr << name << ": can't create shared memory " << shm_name
+                      << ": " << strerror(errno) << std::endl;
+    }
+
+public:
+    ~ShmSink(){
+        // the reader shell not see a half written frame of a running node
+        this->stop();
+    }
+
+protected:
+    virtual bool process_usr_msg(tPtrIn&& msg){
+        if(msg->cmd != MSG_CMD::NONE || !ring.attached()) return true;
+
+        gather_record(*msg, rec);
+        if(rec.bytes > ring.slot_bytes()){
+            std::cerr << tBase::name << " warning: " << rec.bytes - sizeof(MsgRecord)
+                      << " bytes frame does not fit the slot" << std::endl;
+            return true;
+        }
+
+        auto frame = ring.begin_write();
+        if(!frame && pol == QUEUE_POLICY::WAIT){
+            // a short spin for the reader that is just behind, then sleep until it frees a slot
+            auto until = std::chrono::steady_clock::now() + wait_timeout;
+            for(int i = 0; !frame; i++){
+                auto now = std::chrono::steady_clock::now();
+                if(now >= until) break;
+                if(i < 64) std::this_thread::yield();
+                else ring.wait_writable(std::chrono::duration_cast<std::chrono::microseconds>(until - now));
+                frame = ring.begin_write();
+            }
+        }
+        if(!frame){
+            this->stats.drop(DROP_REASON::QUEUE_FULL);
+            return true;
+        }
+
+        flatten_record(rec, frame);
+        ring.end_write();
+        return true;
+    }
+
+private:
+    ShmRing ring;
+    MsgGather rec;
+    QUEUE_POLICY pol;
+    std::chrono::milliseconds wait_timeout;
+};
+
+template<typename T>
+class ShmSource : public BaseSource<T>{
+public:
+    using tBase = BaseSource<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrOut = typename tBase::tPtrOut;
+
+protected:
+    friend class NodeFactory;
+    ShmSource(std::string shm_name, QUEUE_POLICY pol = QUEUE_POLICY::DROP, std::string name = "ShmSource"):
+            tBase(nullptr, pol, name), shm_name{shm_name} {}
+
+    virtual void main_loop(){
+        int idle = 0, sleeps = 0;
+        while(1){
+            // the commands are checked between the bursts of frames
+            tPtrIn curr_in = this->pull_msg(false);
+            if(curr_in && curr_in->cmd == MSG_CMD::STOP) break;
+
+            if(!ring.attached() && !ring.open(shm_name)){
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+
+            size_t n = 0;
+            const char* frame;
+            while(n < 32 && (frame = ring.begin_read())){
+                forward(frame);
+                ring.end_read();
+                n++;
+            }
+
+            if(n){
+                idle = sleeps = 0;
+                continue;
+            }
+
+            // a short spin for the next frame of a burst, then sleep until the writer
+            // wakes us, the commands are checked each 10ms
+            if(++idle < 64){
+                std::this_thread::yield();
+                continue;
+            }
+            ring.wait_readable(std::chrono::milliseconds(10));
+
+            // the writer could be restarted, it is checked about each 100ms of silence
+            if(!ring.begin_read() && ++sleeps % 10 == 0 && ring.stale()) ring.detach();
+        }
+        ring.detach();
+    }
+
+private:
+    void forward(const char* frame){
+        if(!this->next) return;
+
+        MsgRecordView rec(frame, ring.slot_bytes());
+        auto out = MsgPool<T>::acquire();
+        if(!rec.valid() || !deserialize(rec, *out)){
+            std::cerr << tBase::name << " warning: malformed frame" << std::endl;
+            return;
+        }
+        this->next->put(move(out), this->uid, this->pol);
+    }
+
+private:
+    std::string shm_name;
+    ShmRing ring;
+};
+
+#endif //DISTPIPELINEFWK_SHM_EDGE_HPP
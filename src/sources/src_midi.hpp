@@ -96,6 +96,7 @@ private:
             out_msg->sent_from = srcObj->uid;
             out_msg->bytes = std::move(*message);
             out_msg->deltatime = deltatime;
+            srcObj->stamp(*out_msg);
 
             srcObj->next->put(move(out_msg), srcObj->uid, srcObj->pol);
         }
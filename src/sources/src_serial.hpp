@@ -25,11 +25,21 @@ struct SerialOutPkt : public BaseMessage{
     // copy constructor
     SerialOutPkt(const SerialOutPkt& pkt) : BaseMessage(pkt), block{pkt.block} {}
 
+    virtual size_t payload_size() const {
+        return block.size();
+    }
+
     // This client works in binary mode, each USB packet is a data block, and an information
     // shell be decoded afterwards.
     std::vector<char> block;
 };
 
+// the raw block is the record body
+template<>
+struct MsgSerializer<SerialOutPkt> : public MsgVectorSerializer<SerialOutPkt, char, std::vector<char>, &SerialOutPkt::block>{
+    static const char* name(){return "SerialOutPkt";}
+};
+
 
 template<typename tIn, int MaxPktSize = 1024>
 class SerialPortSRC : public BaseFilter<tIn, SerialOutPkt>{
@@ -26,11 +26,21 @@ struct UDPOutPkt : public BaseMessage{
     // copy constructor
     UDPOutPkt(const UDPOutPkt& pkt) : BaseMessage(pkt), block{pkt.block} {}
 
+    virtual size_t payload_size() const {
+        return block.size();
+    }
+
     // This client works in binary mode, each UDP packet is a data block, and an information
     // shell be decoded afterwards.
     std::vector<char> block;
 };
 
+// the raw datagram is the record body
+template<>
+struct MsgSerializer<UDPOutPkt> : public MsgVectorSerializer<UDPOutPkt, char, std::vector<char>, &UDPOutPkt::block>{
+    static const char* name(){return "UDPOutPkt";}
+};
+
 template<int MaxPktSize = 1024>
 class UDPSource : public BaseSource<UDPOutPkt>{
 
@@ -103,6 +113,7 @@ protected:
                 if(this->next){
                     std::shared_ptr<UDPOutPkt> pkt(new UDPOutPkt);
                     pkt->block = std::move(blocks.front());
+                    this->stamp(*pkt);
                     this->next->put(move(pkt), this->uid, this->pol);
                 }
                 blocks.pop_front();
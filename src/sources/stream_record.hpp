@@ -0,0 +1,321 @@
+#ifndef DISTPIPELINEFWK_STREAM_RECORD_HPP
+#define DISTPIPELINEFWK_STREAM_RECORD_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base_source.hpp"
+#include "msg_pool.hpp"
+#include "serialization.h"
+
+/*
+ * Recording and replay of the messages passing an edge. StreamRecorder<T> is a sink
+ * that appends each message to a memory mapped file with it's arrival time,
+ * StreamReplayer<T> is a source that sends them again, at the original timing or
+ * as fast as the graph can take them:
+ *
+ * auto rec = NodeFactory::create<StreamRecorder<UDPOutPkt>>("capture.dpf");
+ * udp->set_target(rec);
+ * ...
+ * auto replay = NodeFactory::create<StreamReplayer<UDPOutPkt>>("capture.dpf", 0.0);
+ * replay->set_target(decoder);
+ *
+ * So a capture of the real acquisition is a reproducible input for the debugging
+ * and the throughput measurements of the DSP graph.
+ *
+ * The file is a StreamFileHeader followed by the entries: [arrival time, int64 ns
+ * since the first entry][message record (see serialization.h)]. The entries are 8
+ * bytes aligned, so the replayer reads the payloads in place from the mapping. The
+ * header keeps the committed size, it is updated after each entry, so the file
+ * written by a crashed process is still readable up to the last complete entry.
+ * The UID and the USER commands with a registered data type are recorded too.
+ */
+
+struct StreamFileHeader{
+    static constexpr uint32_t magic = 0x53465044; // "DPFS"
+    static constexpr uint32_t version = 2;
+
+    uint32_t tag;
+    uint32_t format;
+
+    // the wall clock time of the first entry, ns since the epoch
+    int64_t start_unix_ns;
+
+    // the bytes of the complete entries after the header
+    std::atomic<uint64_t> data_bytes;
+    std::atomic<uint64_t> n_entries;
+
+    uint64_t reserved[4];
+};
+
+static_assert(sizeof(StreamFileHeader) == 64, "StreamFileHeader is a part of the file format");
+
+template<typename T>
+class StreamRecorder : public BaseNode<T>{
+public:
+    using tBase = BaseNode<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+
+protected:
+    friend class NodeFactory;
+
+    /*
+     * The file is created (an existing one is replaced) and grows by 'chunk_bytes',
+     * at the end it is truncated to the written size.
+     */
+    StreamRecorder(std::string file, std::string name = "StreamRecorder", size_t chunk_bytes = 1 << 26):
+            tBase(name), file{file}, chunk_bytes{std::max<size_t>(chunk_bytes, 1 << 16)} {
+        fd = ::open(file.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if(fd < 0 || !remap(this->chunk_bytes)){
+            std::cerr << name << ": can't create " << file << ": " << strerror(errno) << std::endl;
+            close_file();
+            return;
+        }
+        hdr->tag = StreamFileHeader::magic;
+        hdr->format = StreamFileHeader::version;
+    }
+
+public:
+    ~StreamRecorder(){
+        // no entry shell be written after the file is closed
+        this->stop();
+        close_file();
+    }
+
+    size_t recorded() const {return hdr ? (size_t)hdr->n_entries.load() : 0;}
+
+protected:
+    virtual bool process_usr_msg(tPtrIn&& msg){
+        if(!hdr || (msg->cmd != MSG_CMD::NONE && msg->cmd != MSG_CMD::USER)) return true;
+
+        if(!gather_record(*msg, rec)){
+            if(!cmd_warned)
+                std::cerr << tBase::name << " warning: command data type is not registered, not recorded" << std::endl;
+            cmd_warned = true;
+            return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(hdr->n_entries.load(std::memory_order_relaxed) == 0){
+            t0 = now;
+            hdr->start_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        int64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(now - t0).count();
+
+        size_t pos = sizeof(StreamFileHeader) + hdr->data_bytes.load(std::memory_order_relaxed);
+        size_t bytes = sizeof(ts) + rec.bytes;
+        if(pos + bytes > len && !remap(std::max(2*len, pos + bytes + chunk_bytes))){
+            std::cerr << tBase::name << ": can't grow " << file << ": " << strerror(errno)
+                      << ", the recording is stopped" << std::endl;
+            close_file();
+            return true;
+        }
+
+        memcpy(base + pos, &ts, sizeof(ts));
+        flatten_record(rec, base + pos + sizeof(ts));
+        hdr->n_entries.fetch_add(1, std::memory_order_relaxed);
+        hdr->data_bytes.store(pos + bytes - sizeof(StreamFileHeader), std::memory_order_release);
+        return true;
+    }
+
+private:
+    // the file is extended to 'new_len' and mapped again
+    bool remap(size_t new_len){
+        new_len = (new_len + chunk_bytes - 1)/chunk_bytes*chunk_bytes;
+        if(base) munmap(base, len);
+        base = nullptr;
+        hdr = nullptr;
+
+        if(ftruncate(fd, (off_t)new_len) != 0) return false;
+        void* p = mmap(nullptr, new_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) return false;
+        base = static_cast<char*>(p);
+        hdr = reinterpret_cast<StreamFileHeader*>(base);
+        len = new_len;
+        return true;
+    }
+
+    void close_file(){
+        size_t used = hdr ? sizeof(StreamFileHeader) + hdr->data_bytes.load() : 0;
+        if(base) munmap(base, len);
+        if(fd >= 0){
+            if(used && ftruncate(fd, (off_t)used) != 0)
+                std::cerr << tBase::name << " warning: can't truncate " << file << std::endl;
+            ::close(fd);
+        }
+        base = nullptr;
+        hdr = nullptr;
+        fd = -1;
+    }
+
+private:
+    std::string file;
+    size_t chunk_bytes;
+    int fd = -1;
+    char* base = nullptr;
+    StreamFileHeader* hdr = nullptr;
+    size_t len = 0;
+
+    MsgGather rec;
+    std::chrono::steady_clock::time_point t0;
+    bool cmd_warned = false;
+};
+
+template<typename T>
+class StreamReplayer : public BaseSource<T>{
+public:
+    using tBase = BaseSource<T>;
+    using tPtrIn = typename tBase::tPtrIn;
+    using tPtrOut = typename tBase::tPtrOut;
+
+protected:
+    friend class NodeFactory;
+
+    /*
+     * 'speed' scales the recorded timing: 1.0 - the original one, 2.0 - twice faster,
+     * 0.0 - as fast as possible. With 'loop' the file is replayed again and again.
+     * The default WAIT policy does not lose the messages when the graph is slower
+     * than the replay, DROP reproduces the behaviour of the live source.
+     */
+    StreamReplayer(std::string file, double speed = 1.0, bool loop = false,
+                   QUEUE_POLICY pol = QUEUE_POLICY::WAIT, std::string name = "StreamReplayer"):
+            tBase(nullptr, pol, name), file{file}, speed{speed}, loop{loop} {}
+
+    virtual void main_loop(){
+        if(!open_file()){
+            std::cerr << tBase::name << ": can't read " << file << std::endl;
+            wait_stop();
+            return;
+        }
+
+        // the replay starts when the target is set, the beginning of the file is not lost
+        bool stopped = false;
+        while(!this->next && !stopped)
+            stopped = sleep_until(std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+
+        const char* end = base + sizeof(StreamFileHeader) + data_bytes;
+        size_t sent = 0;
+        auto started = std::chrono::steady_clock::now();
+
+        while(!stopped){
+            auto t0 = std::chrono::steady_clock::now();
+            const char* pos = base + sizeof(StreamFileHeader);
+            size_t sent_before = sent;
+
+            for(size_t n = 0; pos + sizeof(int64_t) < end && !stopped; n++){
+                int64_t ts;
+                memcpy(&ts, pos, sizeof(ts));
+                MsgRecordView rec(pos + sizeof(ts), end - pos - sizeof(ts));
+                if(!rec.valid()){
+                    std::cerr << tBase::name << " warning: " << file << " is truncated" << std::endl;
+                    break;
+                }
+
+                if(speed > 0.0){
+                    auto at = t0 + std::chrono::nanoseconds((int64_t)(ts/speed));
+                    stopped = sleep_until(at);
+                }else if(n % 64 == 0){
+                    // the commands are checked between the bursts
+                    stopped = stop_received();
+                }
+                if(stopped) break;
+
+                if(rec.is<T>() && this->next){
+                    auto out = MsgPool<T>::acquire();
+                    if(deserialize(rec, *out)){
+                        out->sent_from = this->uid;
+                        this->next->put(move(out), this->uid, this->pol);
+                        sent++;
+                    }
+                }
+                pos += sizeof(ts) + rec.size();
+            }
+
+            // nothing to loop over in a file without the messages of type T
+            if(!loop || sent == sent_before) break;
+        }
+
+        if(!stopped){
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            std::cout << tBase::name << ": " << sent << " messages replayed in " << ms << " ms" << std::endl;
+            wait_stop();
+        }
+        close_file();
+    }
+
+private:
+    bool open_file(){
+        int fd = ::open(file.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(StreamFileHeader)){
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(p == MAP_FAILED) return false;
+        base = static_cast<const char*>(p);
+        len = (size_t)st.st_size;
+
+        auto hdr = reinterpret_cast<const StreamFileHeader*>(base);
+        if(hdr->tag != StreamFileHeader::magic || hdr->format != StreamFileHeader::version){
+            close_file();
+            return false;
+        }
+        data_bytes = std::min<size_t>(hdr->data_bytes.load(std::memory_order_acquire),
+                                      len - sizeof(StreamFileHeader));
+        return true;
+    }
+
+    void close_file(){
+        if(base) munmap(const_cast<char*>(base), len);
+        base = nullptr;
+    }
+
+    bool stop_received(){
+        tPtrIn curr_in = this->pull_msg(false);
+        return curr_in && curr_in->cmd == MSG_CMD::STOP;
+    }
+
+    // true if STOP is received while waiting
+    bool sleep_until(std::chrono::steady_clock::time_point at){
+        while(1){
+            if(stop_received()) return true;
+            auto left = at - std::chrono::steady_clock::now();
+            if(left <= std::chrono::steady_clock::duration::zero()) return false;
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(left, std::chrono::milliseconds(10)));
+        }
+    }
+
+    void wait_stop(){
+        while(1){
+            tPtrIn curr_in = this->pull_msg(true);
+            if(curr_in && curr_in->cmd == MSG_CMD::STOP) break;
+        }
+    }
+
+private:
+    std::string file;
+    double speed;
+    bool loop;
+
+    const char* base = nullptr;
+    size_t len = 0;
+    size_t data_bytes = 0;
+};
+
+#endif //DISTPIPELINEFWK_STREAM_RECORD_HPP